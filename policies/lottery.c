@@ -0,0 +1,115 @@
+/*
+ * lottery.c
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * Lottery scheduling, as a policy module: every ready process holds
+ * tickets, more the higher its priority, and each dispatch draws one
+ * ticket at random.  Over time each process gets CPU in proportion to its
+ * tickets, and none can starve.
+ *
+ * Build with "make policies" and run with
+ *
+ *     ./os-sim <# CPUs> -P ./lottery.so[:<seed>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "os-sim.h"
+#include "sched-ops.h"
+
+
+/*
+ * A larger priority value is a higher priority: priority 0 (the lowest) is
+ * worth a single ticket, each level above one more, up to MAX_TICKETS.
+ */
+#define MAX_TICKETS 10
+
+/* The ready processes, linked by pid through their next fields */
+static unsigned int head = PID_NONE;
+static unsigned int total_tickets = 0;
+static unsigned long long draws = 0, rng = 2200;
+
+
+static unsigned int tickets(const pcb_t *process)
+{
+    return process->priority < MAX_TICKETS - 1 ?
+        process->priority + 1 : MAX_TICKETS;
+}
+
+/* xorshift64, so runs are repeatable for a given seed */
+static unsigned long long next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static int lottery_init(unsigned int cpu_count, const char *args)
+{
+    (void)cpu_count;
+
+    if (args != NULL)
+        rng = strtoull(args, NULL, 0);
+    if (rng == 0)
+    {
+        fprintf(stderr, "lottery: the seed must not be 0\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void lottery_enqueue(pcb_t *process)
+{
+    process->next = head;
+    head = process->pid;
+    total_tickets += tickets(process);
+}
+
+static pcb_t *lottery_pick_next(unsigned int cpu_id)
+{
+    unsigned int winner, pid, *link = &head;
+    pcb_t *process;
+
+    (void)cpu_id;
+
+    if (head == PID_NONE)
+        return NULL;
+
+    /* Walk the queue to the holder of the winning ticket */
+    winner = (unsigned int)(next_random() % total_tickets);
+    for (pid = head; ; pid = process->next)
+    {
+        process = pcb_of(pid);
+        if (winner < tickets(process))
+            break;
+        winner -= tickets(process);
+        link = &process->next;
+    }
+
+    *link = process->next;
+    total_tickets -= tickets(process);
+    draws++;
+    return process;
+}
+
+static int lottery_empty(void)
+{
+    return head == PID_NONE;
+}
+
+static void lottery_print_stats(void)
+{
+    printf("Lottery draws: %llu\n", draws);
+}
+
+const sched_ops_t sched_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "lottery",
+    .init = lottery_init,
+    .enqueue = lottery_enqueue,
+    .pick_next = lottery_pick_next,
+    .empty = lottery_empty,
+    .print_stats = lottery_print_stats
+};
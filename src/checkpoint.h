@@ -0,0 +1,32 @@
+/*
+ * checkpoint.h
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * Helpers for writing and reading checkpoints.  A checkpoint is read back
+ * by the same build on the same host, so values are written as they lie in
+ * memory, with no framing beyond what each section records itself.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+
+/*
+ * CHECKPOINT_SAVE() writes the variable x, CHECKPOINT_SAVE_ARRAY() the
+ * first n elements of array a.  Write errors show up in ferror().
+ *
+ * CHECKPOINT_LOAD() and CHECKPOINT_LOAD_ARRAY() read them back, and are
+ * nonzero on success.
+ */
+#define CHECKPOINT_SAVE(f, x) \
+    ((void)fwrite(&(x), sizeof(x), 1, (f)))
+
+#define CHECKPOINT_SAVE_ARRAY(f, a, n) \
+    ((void)fwrite((a), sizeof(*(a)), (n), (f)))
+
+#define CHECKPOINT_LOAD(f, x) \
+    (fread(&(x), sizeof(x), 1, (f)) == 1)
+
+#define CHECKPOINT_LOAD_ARRAY(f, a, n) \
+    (fread((a), sizeof(*(a)), (n), (f)) == (size_t)(n))
@@ -0,0 +1,135 @@
+/*
+ * heap.c
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * A binary min-heap.  See heap.h.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "heap.h"
+
+
+#define HEAP_INITIAL_CAPACITY 16
+
+static int heap_less(const heap_entry_t *a, const heap_entry_t *b);
+
+
+static int heap_less(const heap_entry_t *a, const heap_entry_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key;
+    return a->seq < b->seq;
+}
+
+extern void heap_init(heap_t *heap)
+{
+    heap->entries = NULL;
+    heap->size = 0;
+    heap->capacity = 0;
+    heap->seq = 0;
+}
+
+extern void heap_push(heap_t *heap, double key, void *item)
+{
+    unsigned int n, parent;
+    heap_entry_t entry;
+
+    if (heap->size == heap->capacity)
+    {
+        heap->capacity = heap->capacity ? heap->capacity * 2 :
+            HEAP_INITIAL_CAPACITY;
+        heap->entries = realloc(heap->entries,
+            sizeof(heap_entry_t) * heap->capacity);
+        assert(heap->entries != NULL);
+    }
+
+    entry.key = key;
+    entry.seq = heap->seq++;
+    entry.item = item;
+
+    /* Sift up */
+    n = heap->size++;
+    while (n > 0)
+    {
+        parent = (n - 1) / 2;
+        if (!heap_less(&entry, &heap->entries[parent]))
+            break;
+        heap->entries[n] = heap->entries[parent];
+        n = parent;
+    }
+    heap->entries[n] = entry;
+}
+
+extern void *heap_pop(heap_t *heap)
+{
+    unsigned int n, child;
+    heap_entry_t last;
+    void *top;
+
+    if (heap->size == 0)
+        return NULL;
+
+    top = heap->entries[0].item;
+    last = heap->entries[--heap->size];
+
+    /* Sift the last entry down from the root */
+    n = 0;
+    while ((child = 2 * n + 1) < heap->size)
+    {
+        if (child + 1 < heap->size &&
+            heap_less(&heap->entries[child + 1], &heap->entries[child]))
+            child++;
+        if (!heap_less(&heap->entries[child], &last))
+            break;
+        heap->entries[n] = heap->entries[child];
+        n = child;
+    }
+    if (heap->size > 0)
+        heap->entries[n] = last;
+
+    return top;
+}
+
+extern int heap_remove(heap_t *heap, const void *item)
+{
+    unsigned int n, child, parent;
+    heap_entry_t last;
+
+    for (n=0; n<heap->size && heap->entries[n].item != item; n++)
+        ;
+    if (n == heap->size)
+        return 0;
+
+    last = heap->entries[--heap->size];
+    if (n == heap->size)
+        return 1;
+
+    /* The last entry takes the hole, and sifts up or down from there */
+    while (n > 0)
+    {
+        parent = (n - 1) / 2;
+        if (!heap_less(&last, &heap->entries[parent]))
+            break;
+        heap->entries[n] = heap->entries[parent];
+        n = parent;
+    }
+    while ((child = 2 * n + 1) < heap->size)
+    {
+        if (child + 1 < heap->size &&
+            heap_less(&heap->entries[child + 1], &heap->entries[child]))
+            child++;
+        if (!heap_less(&heap->entries[child], &last))
+            break;
+        heap->entries[n] = heap->entries[child];
+        n = child;
+    }
+    heap->entries[n] = last;
+    return 1;
+}
+
+extern const heap_entry_t *heap_peek(const heap_t *heap)
+{
+    return heap->size > 0 ? &heap->entries[0] : NULL;
+}
@@ -0,0 +1,46 @@
+/*
+ * heap.h
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * A binary min-heap, used for ready queues that are ordered by a key rather
+ * than by arrival.  Items are usually PCBs, but can be anything the
+ * scheduler orders (process groups, for instance).
+ */
+
+#pragma once
+
+
+/*
+ * Entries with equal keys come out in the order they went in, so a heap
+ * with a constant key behaves like a FIFO queue.
+ */
+typedef struct {
+    double key;
+    unsigned long seq;
+    void *item;
+} heap_entry_t;
+
+typedef struct {
+    heap_entry_t *entries;
+    unsigned int size;
+    unsigned int capacity;
+    unsigned long seq;
+} heap_t;
+
+
+/*
+ * None of these functions lock; the caller protects the heap.
+ *
+ *   heap_push() : inserts item with the given key in O(log n)
+ *   heap_pop()  : removes and returns the item with the smallest key, or
+ *                 NULL if the heap is empty, in O(log n)
+ *   heap_peek() : returns the entry with the smallest key without removing
+ *                 it, or NULL if the heap is empty
+ *   heap_remove() : removes item wherever it is, in O(n), and returns 1, or
+ *                 0 if it is not in the heap
+ */
+extern void heap_init(heap_t *heap);
+extern void heap_push(heap_t *heap, double key, void *item);
+extern void *heap_pop(heap_t *heap);
+extern const heap_entry_t *heap_peek(const heap_t *heap);
+extern int heap_remove(heap_t *heap, const void *item);
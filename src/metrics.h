@@ -0,0 +1,61 @@
+/*
+ * metrics.h
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * The live metrics the simulator publishes, with -M <name>, in a POSIX
+ * shared memory segment of that name, for monitors running alongside it
+ * (tools/metrics.c is one).  The supervisor rewrites the segment once per
+ * tick, when it draws the Gantt line.
+ *
+ * The segment is guarded by a seqlock, so neither side ever blocks the
+ * other.  The writer makes seq odd, updates the fields, and makes seq even
+ * again; a reader copies the fields between two loads of seq, and keeps
+ * the copy only if both loads saw the same even value.  Every field is a
+ * 32-bit word accessed with relaxed atomics, so a torn copy is merely
+ * discarded, never undefined.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+#define METRICS_MAGIC 0x4d49534fu
+#define METRICS_VERSION 1u
+#define METRICS_CPUS 16
+
+/* A CPU running the idle process */
+#define METRICS_IDLE 0xffffffffu
+
+typedef struct {
+    uint32_t seq;
+
+    /* Set once when the segment is created */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cpu_count;
+
+    /* Rewritten every tick; done is set when the simulation is over */
+    uint32_t tick;
+    uint32_t ready;
+    uint32_t running;
+    uint32_t waiting;
+    uint32_t io_queue;
+    uint32_t context_switches;
+    uint32_t migrations;
+    uint32_t processes_created;
+    uint32_t processes_terminated;
+    uint32_t done;
+    uint32_t cpu_pid[METRICS_CPUS];
+} metrics_t;
+
+
+/*
+ * METRICS_STORE() and METRICS_LOAD() are the only accesses to the fields
+ * other than seq.
+ */
+#define METRICS_STORE(field, value) \
+    __atomic_store_n(&(field), (uint32_t)(value), __ATOMIC_RELAXED)
+
+#define METRICS_LOAD(field) \
+    __atomic_load_n(&(field), __ATOMIC_RELAXED)
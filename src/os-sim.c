@@ -9,15 +9,24 @@
  */
 
 #include <assert.h>
+#include <fcntl.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
+#include "checkpoint.h"
+#include "metrics.h"
 #include "os-sim.h"
 #include "process.h"
+#include "profile.h"
 #include "student.h"
+#include "timer-wheel.h"
 
 
 typedef enum {
@@ -28,14 +37,56 @@ typedef enum {
     CPU_TERMINATE
 } simulator_cpu_state_t;
 
+typedef enum {
+    POWER_ACTIVE = 0,
+    POWER_SHALLOW,
+    POWER_DEEP,
+    POWER_STATES
+} power_state_t;
+
 typedef struct {
     pcb_t *current;
     simulator_cpu_state_t state;
     pthread_cond_t wakeup;
+
+    /*
+     * The running process's burst and time slice are not counted down tick
+     * by tick.  work_start is the first tick of useful work at which the
+     * cursor and preemption_timer were last brought up to date, and timer
+     * is armed for whichever of the two runs out first.  No work is done
+     * before penalty_until, while the CPU pays for a switch.  The process
+     * retires rate/RATE_ONE ticks of work per tick; remote is set if it
+     * runs away from its memory.  busy_ticks counts the ticks of useful
+     * work the CPU has done.
+     */
     int preemption_timer;
+    unsigned int work_start;
+    unsigned int penalty_until;
+    unsigned int rate;
+    int remote;
+    unsigned long busy_ticks;
+    wheel_timer_t timer;
+
+    /*
+     * Under the energy model, the CPU runs at frequency percent of nominal
+     * while it has a process, and has been idle since idle_since
+     * otherwise.  Its energy, in milliwatt ticks, and residency[], in
+     * ticks per power state, are brought up to date to power_since.
+     */
+    unsigned int frequency;
+    unsigned int idle_since;
+    unsigned int power_since;
+    unsigned long residency[POWER_STATES];
+    double energy;
+#ifdef PROFILE
+    unsigned long long preempt_stamp;
+#endif
 } simulator_cpu_data_t;
 
-/* The I/O queue is a simple, FIFO queue using a linked list */
+/*
+ * The I/O queue is a simple, FIFO queue using a linked list.  Only the head
+ * request is in service; io_timer is armed for its completion.
+ */
 typedef struct _io_request {
     pcb_t *pcb;
     unsigned int execution_time;
@@ -43,6 +94,64 @@ typedef struct _io_request {
 } io_request;
 
 
+/*
+ * Every process that exists in the simulation, indexed by pid.  The PCBs,
+ * one cache line each, are allocated PCB_CHUNK at a time in aligned chunks
+ * so they never move as the table grows.  The program and program counter
+ * the simulator advances on each event are kept in the parallel arrays
+ * program[] and cursor[], and the rest, which is seldom looked at, in
+ * process_table[].  For the closed workload the processes are made from the
+ * entries of processes[]; an open arrival model makes one per arrival.
+ *
+ * Under the threaded workload every thread has an entry of its own, which
+ * records the entry of threaded_processes[] it was made from (model) and
+ * which of its threads it is.  The first thread's pid, group, stands for
+ * the process: its entry also counts the threads, those not terminated yet
+ * and those waiting at a barrier.  A thread in_barrier has been waiting
+ * there since barrier_since.
+ *
+ * A process waiting for a lock is blocked_on its resource, behind
+ * lock_next in the resource's queue, since lock_since; inverted counts the
+ * ticks of that wait its lock's holder spent ready but not running.  A
+ * process holding locks has waiters processes waiting on it, directly or
+ * through the locks their own holders wait for, of priorities
+ * waiters_low to waiters_high (see lock_waiters()).
+ *
+ * live[] holds the pids of the processes that may not have terminated yet,
+ * so that the Gantt chart does not walk the whole table every tick.
+ */
+#define PCB_CHUNK_SHIFT 10
+#define PCB_CHUNK (1u << PCB_CHUNK_SHIFT)
+
+#define WORKLOAD_MAX (PROCESS_COUNT > THREADED_COUNT ? \
+    PROCESS_COUNT : THREADED_COUNT)
+
+typedef struct {
+    const char *name;
+    int last_cpu;
+    int home_node;
+    unsigned int arrival_time;
+    unsigned int model, thread, group;
+    unsigned int threads, live_threads, at_barrier;
+    int in_barrier;
+    unsigned int barrier_since;
+    unsigned int blocked_on, lock_next, lock_since, inverted;
+    unsigned int waiters, waiters_low, waiters_high;
+} simulator_process_t;
+
+typedef enum {
+    ARRIVAL_CLOSED = 0,
+    ARRIVAL_POISSON,
+    ARRIVAL_ONOFF,
+    ARRIVAL_TRACE
+} arrival_kind_t;
+
+typedef struct {
+    unsigned int time;
+    int program;
+} trace_arrival_t;
+
+
 static io_request *io_queue_head = NULL, *io_queue_tail = NULL;
 static simulator_cpu_data_t *simulator_cpu_data;
 static pthread_t *cpu_thread;
@@ -52,6 +161,133 @@ static unsigned int processes_terminated = 0;
 static unsigned int cpu_count;
 static unsigned int ready_counter = 0, running_counter = 0, waiting_counter = 0;
 static unsigned int context_switches = 0;
+static unsigned int workload_seed = 0;
+static unsigned int creation_order[WORKLOAD_MAX];
+static unsigned int switch_cost = 0, migration_cost = 0, idle_cost = 0;
+static unsigned int switch_overhead = 0, migrations = 0;
+
+/*
+ * The threaded workload (see set_threaded_workload()).  closed_leader[m] is
+ * the first thread of the closed workload's process of entry m.  Threads a
+ * barrier lets through wait in released[] for their wake_up() until every
+ * CPU due this tick has been handled.  barrier_waits counts the arrivals
+ * at barriers, barrier_ticks and barrier_max the time spent waiting there.
+ */
+static int threaded = 0;
+static unsigned int closed_leader[WORKLOAD_MAX];
+static unsigned int *released, released_count = 0;
+static unsigned int barrier_waits = 0, barrier_max = 0;
+static unsigned long barrier_ticks = 0;
+
+/*
+ * Locks (OP_LOCK and OP_UNLOCK) on the resources of resource_names[].  A
+ * resource is held by holder since held_since, and the processes waiting
+ * for it queue up FIFO from head to tail.  hold_times[] and wait_times[]
+ * collect the length of every hold and every wait that has ended, grown
+ * TIMES_CHUNK at a time.  A wait during which the holder was ready but
+ * not running counts as an inversion.  holder, blocked_on and the waiters
+ * fields are read by the student's code, so are written atomically.
+ */
+#define NO_RESOURCE 0xffffffffu
+#define TIMES_CHUNK 256u
+
+typedef struct {
+    unsigned int holder, held_since;
+    unsigned int head, tail;
+    unsigned int acquisitions, contended;
+} resource_t;
+
+static resource_t resources[RESOURCE_COUNT];
+static unsigned int *hold_times, hold_count = 0;
+static unsigned int *wait_times, wait_count = 0;
+static unsigned int inversions = 0, inversion_max = 0;
+static unsigned long inversion_ticks = 0;
+
+/* Timers are owned by a CPU id, or by the I/O device */
+#define IO_TIMER 16u
+static timer_wheel_t timers;
+static wheel_timer_t io_timer;
+static int in_tick = 0;
+
+/*
+ * The topology (see set_topology()): CPU n is on node n / node_cpus.
+ * local_ticks and remote_ticks count the ticks processes ran on their own
+ * node and on another one.
+ */
+#define RATE_ONE 1024u
+
+static unsigned int sockets = 1, cores = 0, threads = 1, node_cpus;
+static unsigned int remote_penalty = 0;
+static unsigned long local_ticks = 0, remote_ticks = 0;
+static unsigned int remote_dispatches = 0;
+
+/*
+ * capacities[n] is the work CPU n retires per tick, in percent of a nominal
+ * CPU (see set_cpu_capacity()); 0 until start_simulator() fills in 100.
+ */
+static unsigned int capacities[16];
+
+/*
+ * The energy model (see set_power_states()).  A CPU of capacity 100 draws
+ * MW_STATIC plus MW_DYNAMIC times the cube of its relative frequency
+ * milliwatts while it has a process (switching and waking up included),
+ * MW_SHALLOW in shallow idle and MW_DEEP in deep idle; a CPU of any
+ * other capacity draws in proportion.  frequencies[n] is the frequency
+ * CPU n takes at its next dispatch, 0 for nominal, and parked[n] is set
+ * while the scheduler keeps it out of use.  Both are written by the
+ * student's code, so are accessed atomically.
+ */
+#define MW_STATIC 300.0
+#define MW_DYNAMIC 700.0
+#define MW_SHALLOW 150.0
+#define MW_DEEP 10.0
+
+static int power_model = 0;
+static unsigned int deep_after = 0, shallow_exit = 0, deep_exit = 0;
+static unsigned int frequencies[16];
+static int parked[16];
+static unsigned int idle_exits[POWER_STATES];
+static unsigned long exit_latency = 0;
+
+/*
+ * In deterministic mode only the CPU holding the idle turn may be inside
+ * idle(); idle CPUs otherwise wait for their turn in the simulator.  See
+ * settle().
+ */
+static int deterministic = 0;
+static unsigned int idle_turn = 0;
+static pthread_cond_t settled;
+
+/*
+ * A checkpoint is written at the start of tick checkpoint_tick, if
+ * checkpoint_path is set; restore_path names one to start from instead.
+ */
+#define CHECKPOINT_MAGIC 0x4b43534fu
+#define CHECKPOINT_VERSION 6u
+
+static const char *checkpoint_path = NULL, *restore_path = NULL;
+static unsigned int checkpoint_tick = 0;
+
+/* The live metrics segment, if -M named one (see metrics.h) */
+static const char *metrics_name = NULL;
+static metrics_t *metrics = NULL;
+
+static pcb_t **pcb_chunk;
+static const op_t **program;
+static op_cursor_t *cursor;
+static simulator_process_t *process_table;
+static unsigned int *live, live_count = 0;
+static unsigned int process_count = 0, process_capacity = 0;
+static unsigned int processes_created = 0;
+static unsigned int *turnaround;
+
+static arrival_kind_t arrival_kind = ARRIVAL_CLOSED;
+static double arrival_rate;
+static unsigned int onoff_on, onoff_off;
+static trace_arrival_t *trace;
+static unsigned int trace_count = 0;
+static unsigned int max_arrivals = 0, horizon = 0;
+static uint32_t arrival_random;
 
 static void simulator_supervisor_thread(void);
 static void simulator_cpu_thread(unsigned int cpu_id);
@@ -61,11 +297,51 @@ int nanosleep(const struct timespec *rqtp, struct timespec *rmtp);
 static void print_gantt_header(void);
 static void print_gantt_line(void);static void print_final_stats(void);
 
-static void simulate_cpus(void);
+static unsigned int pending_tick(void);
+static void simulate_events(void);
+static void dispatch_cpu(unsigned int cpu_id, pcb_t *pcb,
+                         int preemption_time);
+static void charge_switch(unsigned int cpu_id, pcb_t *pcb);
+static unsigned int switch_power(unsigned int cpu_id, pcb_t *pcb);
+static void account_power(unsigned int cpu_id, unsigned int now);
+static void arm_cpu(unsigned int cpu_id);
+static unsigned int burst_ticks(const simulator_cpu_data_t *cpu,
+                                const op_cursor_t *pc);
+static void sync_cpu(unsigned int cpu_id, unsigned int now);
+static void sync_running(void);
+static void settle(void);
 static void simulate_process(unsigned int cpu_id, pcb_t *pcb);
+static const op_t *advance_pc(pcb_t *pcb);
 static void submit_io_request(pcb_t *pcb, unsigned int execution_time);
 static void simulate_io(void);
 static void simulate_creat(void);
+static void shuffle_creation_order(void);
+static void create_process(pcb_t *pcb);
+static void wake_process(pcb_t *pcb);
+static pcb_t *spawn_process(int which);
+static pcb_t *spawn_thread(unsigned int model, unsigned int thread);
+static unsigned int workload_count(void);
+static program_t workload_program(unsigned int model, unsigned int thread);
+static int arrive_barrier(pcb_t *pcb);
+static void open_barrier(unsigned int group);
+static int acquire_lock(pcb_t *pcb, unsigned int resource);
+static void release_lock(unsigned int pid, unsigned int resource);
+static void update_inheritance(unsigned int pid);
+static void record_time(unsigned int **times, unsigned int *count,
+                        unsigned int ticks);
+static void print_times(const char *what, unsigned int *times,
+                        unsigned int count);
+static int load_times(FILE *f, unsigned int **times, unsigned int *count);
+static unsigned int poisson_arrivals(void);
+static uint32_t next_random(void);
+static int simulation_done(void);
+static int compare_uint(const void *a, const void *b);
+static void save_checkpoint(void);
+static void open_metrics(void);
+static void publish_metrics(unsigned int ready, unsigned int running,
+                            unsigned int waiting, unsigned int io_queue);
+static void finish_metrics(void);
+static void restore_checkpoint(void);
 
 static void* simulator_cpu_thread_func(void *data);
 
@@ -99,7 +375,7 @@ typedef struct {
     (i).writers = 0;
 
 #define IRWL_READER_LOCK(i) \
-    pthread_mutex_lock(&(i).mutex); \
+    PROFILE_LOCK(&(i).mutex, PROFILE_STUDENT_LOCK); \
     while ((i).writers > 0) \
     { pthread_cond_wait(&(i).no_writers, &(i).mutex); }
 
@@ -107,12 +383,12 @@ typedef struct {
     pthread_mutex_unlock(&(i).mutex);
 
 #define IRWL_WRITER_LOCK(i) \
-    pthread_mutex_lock(&(i).mutex); \
+    PROFILE_LOCK(&(i).mutex, PROFILE_STUDENT_LOCK); \
     (i).writers++; \
     pthread_mutex_unlock(&(i).mutex);
 
 #define IRWL_WRITER_UNLOCK(i) \
-    pthread_mutex_lock(&(i).mutex); \
+    PROFILE_LOCK(&(i).mutex, PROFILE_STUDENT_LOCK); \
     (i).writers--; \
     if ((i).writers == 0) \
     { pthread_cond_signal(&(i).no_writers); } \
@@ -135,6 +411,17 @@ extern void start_simulator(unsigned int new_cpu_count)
     }
 
 
+    if (cores == 0)
+        cores = cpu_count;
+    if (sockets * cores * threads != cpu_count)
+    {
+        fprintf(stderr, "The topology must have one hardware thread per "
+            "CPU!\n\n");
+        exit(-1);
+    }
+    node_cpus = cores * threads;
+
+
     /* Allocate arrays */
     cpu_thread = malloc(sizeof(pthread_t) * cpu_count);
     assert(cpu_thread != NULL);
@@ -143,15 +430,76 @@ extern void start_simulator(unsigned int new_cpu_count)
 
     /* Initialize mutexes and condition variables */
     pthread_mutex_init(&simulator_mutex, NULL);
+    pthread_cond_init(&settled, NULL);
+    idle_turn = cpu_count;
     simulator_time = 0;
     for (n=0; n<cpu_count; n++)
     {
         simulator_cpu_data[n].current = NULL;
         simulator_cpu_data[n].state = CPU_IDLE;
         simulator_cpu_data[n].preemption_timer = -1;
+        simulator_cpu_data[n].work_start = 0;
+        simulator_cpu_data[n].penalty_until = 0;
+        simulator_cpu_data[n].rate = RATE_ONE;
+        simulator_cpu_data[n].remote = 0;
+        simulator_cpu_data[n].busy_ticks = 0;
+        simulator_cpu_data[n].frequency = 100;
+        simulator_cpu_data[n].idle_since = 0;
+        simulator_cpu_data[n].power_since = 0;
+        memset(simulator_cpu_data[n].residency, 0,
+            sizeof(simulator_cpu_data[n].residency));
+        simulator_cpu_data[n].energy = 0.0;
+        simulator_cpu_data[n].timer.owner = n;
+        if (capacities[n] == 0)
+            capacities[n] = 100;
+        simulator_cpu_data[n].timer.pending = 0;
+#ifdef PROFILE
+        simulator_cpu_data[n].preempt_stamp = 0;
+#endif
         pthread_cond_init(&simulator_cpu_data[n].wakeup, NULL);
     }
 
+    /* Only a deterministic run can be picked up again where it left off */
+    if ((checkpoint_path != NULL || restore_path != NULL) && !deterministic)
+    {
+        fprintf(stderr, "Checkpoints need deterministic mode (-D)!\n\n");
+        exit(-1);
+    }
+
+    if (metrics_name != NULL)
+        open_metrics();
+
+    arrival_random = workload_seed ? workload_seed : 2200;
+    shuffle_creation_order();
+    for (n=0; n<RESOURCE_COUNT; n++)
+    {
+        resources[n].holder = PID_NONE;
+        resources[n].head = PID_NONE;
+        resources[n].tail = PID_NONE;
+    }
+    io_timer.owner = IO_TIMER;
+    io_timer.pending = 0;
+
+    /*
+     * The closed workload makes every process of the workload up front, in
+     * the order of its table.  Under an open arrival model the table only
+     * provides the programs.  A restored simulation makes the processes the
+     * checkpoint holds.
+     */
+    if (restore_path != NULL)
+    {
+        restore_checkpoint();
+    }
+    else
+    {
+        if (arrival_kind == ARRIVAL_CLOSED)
+        {
+            for (n=0; n<workload_count(); n++)
+                spawn_process((int)n);
+        }
+        wheel_init(&timers, simulator_time);
+    }
+
     IRWL_INIT(student_lock)
 
     /* Start CPU threads */
@@ -171,26 +519,39 @@ extern void start_simulator(unsigned int new_cpu_count)
  */
 static void simulator_supervisor_thread(void)
 {
+    unsigned int n;
+
     print_gantt_header();
 
     /* Loop, performing execution every 100ms.  At each execution, we will
        display a line in the Gantt chart and check for pending I/O requests */
     while (1)
     {
-        pthread_mutex_lock(&simulator_mutex);
+        PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
 
         /* Exit when all processes terminate */
-        if (processes_terminated >= PROCESS_COUNT)
+        if (simulation_done())
         {
+            if (checkpoint_path != NULL && simulator_time < checkpoint_tick)
+                fprintf(stderr, "The simulation ended before tick %u; "
+                    "no checkpoint was written\n", checkpoint_tick);
+            finish_metrics();
+            for (n=0; n<cpu_count; n++)
+                account_power(n, simulator_time);
             print_final_stats();
             exit(0);
         }
 
+        if (checkpoint_path != NULL && simulator_time == checkpoint_tick)
+            save_checkpoint();
+
+        in_tick = 1;
         print_gantt_line();
-        simulate_cpus();
-        simulate_io();
+        simulate_events();
         simulate_creat();
+        wheel_advance(&timers);
         simulator_time++;
+        in_tick = 0;
         pthread_mutex_unlock(&simulator_mutex);
 
         mt_safe_usleep(1);
@@ -224,30 +585,53 @@ static void simulator_supervisor_thread(void)
  */
 static void simulator_cpu_thread(unsigned int cpu_id)
 {
-    simulator_cpu_state_t state;
+    simulator_cpu_state_t state = CPU_IDLE;
+    unsigned int group;
+    PROFILE_DECLARE(start);
+    PROFILE_DECLARE(preempt_stamp);
 
     while (1)
     {
-        pthread_mutex_lock(&simulator_mutex);
+        PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
 
-        /* Let the simulator know the scheduler has been run */
-        pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-        if (simulator_cpu_data[cpu_id].current == NULL)
-        {
-            /* the idle process was selected */
-            simulator_cpu_data[cpu_id].state = CPU_IDLE;
-        }
-        else
+        /*
+         * A process dispatched from idle() may reach the end of its slice
+         * or burst before this thread gets back here, as may one restored
+         * from a checkpoint before this thread first gets here.  The event
+         * is then already raised, and the supervisor is waiting for it to
+         * be handled, so handle it rather than start waiting for one.
+         */
+        if (state != CPU_IDLE ||
+            simulator_cpu_data[cpu_id].state == CPU_IDLE ||
+            simulator_cpu_data[cpu_id].state == CPU_RUNNING)
         {
-            /* a process was scheduled */
-            simulator_cpu_data[cpu_id].state = CPU_RUNNING;
+            /* Let the simulator know the scheduler has been run */
+            pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
+
+            if (simulator_cpu_data[cpu_id].current == NULL)
+            {
+                /* the idle process was selected */
+                simulator_cpu_data[cpu_id].state = CPU_IDLE;
+
+                while (deterministic && idle_turn != cpu_id)
+                    pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
+                        &simulator_mutex);
+            }
+            else
+            {
+                /* a process was scheduled */
+                simulator_cpu_data[cpu_id].state = CPU_RUNNING;
 
-            while (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+                while (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
+                    pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
+                        &simulator_mutex);
+            }
         }
         state = simulator_cpu_data[cpu_id].state;
+#ifdef PROFILE
+        preempt_stamp = simulator_cpu_data[cpu_id].preempt_stamp;
+        simulator_cpu_data[cpu_id].preempt_stamp = 0;
+#endif
         pthread_mutex_unlock(&simulator_mutex);
 
         /* Call student's code */
@@ -258,27 +642,41 @@ static void simulator_cpu_thread(unsigned int cpu_id)
              * We can't lock the student_lock for idle(); otherwise we can't
              * print statistics while any CPU is idling.
              */
+            PROFILE_STAMP(start);
             idle(cpu_id);
+            PROFILE_RECORD(PROFILE_IDLE, start);
             break;
 
         case CPU_PREEMPT:
             IRWL_WRITER_LOCK(student_lock)
+            PROFILE_RECORD(PROFILE_FORCE_PREEMPT, preempt_stamp);
+            PROFILE_STAMP(start);
             preempt(cpu_id);
+            PROFILE_RECORD(PROFILE_PREEMPT, start);
             IRWL_WRITER_UNLOCK(student_lock)
             break;
 
         case CPU_YIELD:
             IRWL_WRITER_LOCK(student_lock)
+            PROFILE_STAMP(start);
             yield(cpu_id);
+            PROFILE_RECORD(PROFILE_YIELD, start);
             IRWL_WRITER_UNLOCK(student_lock)
             break;
 
         case CPU_TERMINATE:
-            pthread_mutex_lock(&simulator_mutex);
-            processes_terminated++;
+            /* A process terminates with the last of its threads */
+            PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
+            group = process_table[simulator_cpu_data[cpu_id].current->pid]
+                .group;
+            if (process_table[group].live_threads == 0)
+                turnaround[processes_terminated++] = simulator_time -
+                    process_table[group].arrival_time;
             pthread_mutex_unlock(&simulator_mutex);
             IRWL_WRITER_LOCK(student_lock)
+            PROFILE_STAMP(start);
             terminate(cpu_id);
+            PROFILE_RECORD(PROFILE_TERMINATE, start);
             IRWL_WRITER_UNLOCK(student_lock)
             break;
 
@@ -313,16 +711,17 @@ static void print_gantt_line(void)
 {
     io_request *r;
     unsigned int current_ready = 0, current_running = 0, current_waiting = 0;
-    unsigned int n;
+    unsigned int n, io_queue = 0, resource, holder;
 
 
     /*
-     * Update number of processes in each state.
+     * Update number of processes in each state.  Terminated processes are
+     * dropped from live[] as they are found.
      */
     IRWL_READER_LOCK(student_lock)
-    for (n=0; n<PROCESS_COUNT; n++)
+    for (n=0; n<live_count; )
     {
-        switch(processes[n].state)
+        switch(pcb_of(live[n])->state)
         {
         case PROCESS_READY:
             current_ready++;
@@ -337,11 +736,29 @@ static void print_gantt_line(void)
         case PROCESS_WAITING:
             current_waiting++;
             waiting_counter++;
+
+            /* Behind a holder that waits for a CPU, or for one that does */
+            resource = process_table[live[n]].blocked_on;
+            while (resource != NO_RESOURCE)
+            {
+                holder = resources[resource].holder;
+                if (pcb_of(holder)->state == PROCESS_READY)
+                {
+                    process_table[live[n]].inverted++;
+                    break;
+                }
+                resource = process_table[holder].blocked_on;
+            }
             break;
 
+        case PROCESS_TERMINATED:
+            live[n] = live[--live_count];
+            continue;
+
         default:
             break;
         }
+        n++;
     }
     IRWL_READER_UNLOCK(student_lock)
 
@@ -354,7 +771,7 @@ static void print_gantt_line(void)
     for (n=0; n<cpu_count; n++)
     {
         if (simulator_cpu_data[n].current != NULL)
-            printf(" %-8s", simulator_cpu_data[n].current->name);
+            printf(" %-8s", process_name(simulator_cpu_data[n].current));
         else
             printf(" (IDLE)  ");
     }
@@ -364,49 +781,373 @@ static void print_gantt_line(void)
     r = io_queue_head;
     while (r != NULL)
     {
-        printf(" %s", r->pcb->name);
+        printf(" %s", process_name(r->pcb));
         r = r->next;
+        io_queue++;
     }
     printf(" <\n");
+
+    publish_metrics(current_ready, current_running, current_waiting,
+        io_queue);
 }
 
 static void print_final_stats(void)
 {
+    unsigned int n;
+
     printf("\n\n");
     printf("# of Context Switches: %u\n", context_switches);
     printf("Total execution time: %.1f s\n", (float)simulator_time / 10.0);
     printf("Total time spent in READY state: %.1f s\n", (float)ready_counter / 10.0);
+    printf("Total context switch overhead: %.1f s\n", (float)switch_overhead / 10.0);
+    printf("# of Migrations: %u\n", migrations);
+    if (sockets > 1 && local_ticks + remote_ticks > 0)
+        printf("CPU time: %.1f s on the home node, %.1f s remote (%.1f%% local), "
+            "%u remote dispatches\n", (float)local_ticks / 10.0,
+            (float)remote_ticks / 10.0,
+            100.0 * (double)local_ticks / (double)(local_ticks + remote_ticks),
+            remote_dispatches);
+    for (n=1; n<cpu_count && capacities[n] == capacities[0]; n++)
+        ;
+    if (n < cpu_count)
+    {
+        printf("Busy time per CPU (capacity):");
+        for (n=0; n<cpu_count; n++)
+            printf(" %.1f s (%u%%)",
+                (float)simulator_cpu_data[n].busy_ticks / 10.0, capacities[n]);
+        printf("\n");
+    }
+    if (power_model && simulator_time > 0)
+    {
+        unsigned long residency[POWER_STATES] = { 0 }, all;
+        double energy = 0.0;
+        unsigned int state;
+
+        for (n=0; n<cpu_count; n++)
+        {
+            energy += simulator_cpu_data[n].energy / 10000.0;
+            for (state=0; state<POWER_STATES; state++)
+                residency[state] += simulator_cpu_data[n].residency[state];
+        }
+        all = (unsigned long)simulator_time * cpu_count;
+
+        printf("Energy: %.1f J (mean power %.2f W), energy-delay product "
+            "%.1f J s\n", energy, energy * 10.0 / simulator_time,
+            energy * simulator_time / 10.0);
+        printf("CPU residency: active %.1f%%, shallow idle %.1f%%, "
+            "deep idle %.1f%%\n", 100.0 * residency[POWER_ACTIVE] / all,
+            100.0 * residency[POWER_SHALLOW] / all,
+            100.0 * residency[POWER_DEEP] / all);
+        printf("Idle exits: %u from shallow, %u from deep idle, %.1f s of "
+            "exit latency\n", idle_exits[POWER_SHALLOW],
+            idle_exits[POWER_DEEP], (float)exit_latency / 10.0);
+        if (energy > 0.0)
+            printf("Performance per watt: %.3f processes/J\n",
+                processes_terminated / energy);
+    }
+
+    if (barrier_waits > 0)
+        printf("Barrier waits: %u, mean %.2f s, max %.1f s, total %.1f s\n",
+            barrier_waits, (double)barrier_ticks / barrier_waits / 10.0,
+            (float)barrier_max / 10.0, (float)barrier_ticks / 10.0);
+    for (n=0; n<RESOURCE_COUNT; n++)
+        if (resources[n].acquisitions > 0)
+            printf("Lock %s: %u acquisitions, %u contended\n",
+                resource_names[n], resources[n].acquisitions,
+                resources[n].contended);
+    print_times("Lock hold", hold_times, hold_count);
+    print_times("Lock wait", wait_times, wait_count);
+    if (wait_count > 0)
+        printf("Priority inversion: %u waits, %.1f s behind a ready holder, "
+            "max %.1f s\n", inversions, (float)inversion_ticks / 10.0,
+            (float)inversion_max / 10.0);
+
+    if (arrival_kind != ARRIVAL_CLOSED && simulator_time > 0)
+        printf("Offered load: %.3f arrivals/s (%u arrivals)\n",
+            (double)processes_created * 10.0 / simulator_time,
+            processes_created);
+    if (processes_terminated > 0 && simulator_time > 0)
+    {
+        unsigned long total = 0;
+
+        qsort(turnaround, processes_terminated, sizeof(unsigned int),
+            compare_uint);
+        for (n=0; n<processes_terminated; n++)
+            total += turnaround[n];
+
+        printf("Throughput: %.3f processes/s\n",
+            (double)processes_terminated * 10.0 / simulator_time);
+        printf("Turnaround: mean %.1f s, p50 %.1f s, p95 %.1f s, p99 %.1f s\n",
+            (double)total / processes_terminated / 10.0,
+            (float)turnaround[(processes_terminated - 1) * 50 / 100] / 10.0,
+            (float)turnaround[(processes_terminated - 1) * 95 / 100] / 10.0,
+            (float)turnaround[(processes_terminated - 1) * 99 / 100] / 10.0);
+    }
+    if (processes_created > processes_terminated)
+        printf("Processes unfinished at the horizon: %u\n",
+            processes_created - processes_terminated);
+
+    print_scheduler_stats();
+    PROFILE_REPORT();
 }
 
 
 
 /*
- * context_switch() and force_preempt() are the two functions available to
- * student's code.
+ * context_switch(), context_switch_batch() and force_preempt() are the
+ * functions available to student's code.
  */
 extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
                            int preemption_time)
 {
     assert(cpu_id < cpu_count);
-    assert(pcb == NULL || (pcb >= processes && pcb <= processes +
-        PROCESS_COUNT - 1));
 
     context_switches++;
 
     IRWL_WRITER_UNLOCK(student_lock);
-    pthread_mutex_lock(&simulator_mutex);
-    simulator_cpu_data[cpu_id].current = pcb;
-    simulator_cpu_data[cpu_id].preemption_timer = preemption_time;
+    PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
+    dispatch_cpu(cpu_id, pcb, preemption_time);
+    if (deterministic)
+        pthread_cond_signal(&settled);
+    pthread_mutex_unlock(&simulator_mutex);
+    IRWL_WRITER_LOCK(student_lock);
+}
+
+extern void context_switch_batch(unsigned int count,
+                                 const unsigned int *cpu_ids,
+                                 pcb_t *const *pcbs, const int *time_slices)
+{
+    unsigned int n;
+
+    IRWL_WRITER_UNLOCK(student_lock);
+    PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
+    for (n=0; n<count; n++)
+    {
+        assert(cpu_ids[n] < cpu_count);
+        dispatch_cpu(cpu_ids[n], pcbs[n], time_slices[n]);
+    }
+    context_switches += count;
+    if (deterministic)
+        pthread_cond_signal(&settled);
     pthread_mutex_unlock(&simulator_mutex);
     IRWL_WRITER_LOCK(student_lock);
 }
 
+/*
+ * dispatch_cpu() puts pcb on CPU cpu_id, for context_switch() and
+ * context_switch_batch().  Called with the simulator_mutex held.
+ */
+static void dispatch_cpu(unsigned int cpu_id, pcb_t *pcb, int preemption_time)
+{
+    assert(pcb == NULL || (pcb->pid < process_count &&
+        pcb_of(pcb->pid) == pcb));
+    if (simulator_cpu_data[cpu_id].timer.pending)
+    {
+        sync_cpu(cpu_id, pending_tick());
+        wheel_cancel(&simulator_cpu_data[cpu_id].timer);
+    }
+    charge_switch(cpu_id, pcb);
+    simulator_cpu_data[cpu_id].current = pcb;
+    simulator_cpu_data[cpu_id].preemption_timer = preemption_time;
+    arm_cpu(cpu_id);
+}
+
+/*
+ * charge_switch() works out what it costs CPU cpu_id to go from what it is
+ * running now to pcb, and pushes the end of the CPU's switch penalty back by
+ * that much.  Called with the simulator_mutex held.  Re-dispatching the
+ * process that was just preempted is free.
+ */
+static void charge_switch(unsigned int cpu_id, pcb_t *pcb)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+    unsigned int cost = 0, latency;
+
+    if (pcb == cpu->current)
+        return;
+
+    latency = switch_power(cpu_id, pcb);
+
+    if (cpu->current == NULL || pcb == NULL)
+        cost += idle_cost;
+
+    if (pcb != NULL)
+    {
+        if (cpu->current != NULL)
+            cost += switch_cost;
+
+        if (process_table[pcb->pid].last_cpu >= 0 &&
+            (unsigned int)process_table[pcb->pid].last_cpu != cpu_id)
+        {
+            cost += migration_cost;
+            migrations++;
+        }
+        process_table[pcb->pid].last_cpu = (int)cpu_id;
+
+        /* Memory is first touched where the process first runs */
+        if (process_table[pcb->pid].home_node < 0)
+            process_table[pcb->pid].home_node = (int)cpu_node(cpu_id);
+        else if ((unsigned int)process_table[pcb->pid].home_node !=
+                 cpu_node(cpu_id))
+            remote_dispatches++;
+    }
+
+    if (cost + latency == 0)
+        return;
+    if (cpu->penalty_until < pending_tick())
+        cpu->penalty_until = pending_tick();
+    cpu->penalty_until += cost + latency;
+    switch_overhead += cost;
+}
+
+/*
+ * switch_power() moves CPU cpu_id, which is about to switch to pcb, into
+ * or out of idle under the energy model.  A CPU leaving idle takes the exit
+ * latency of the idle state it had reached, which is returned.  Called
+ * with the simulator_mutex held.
+ */
+static unsigned int switch_power(unsigned int cpu_id, pcb_t *pcb)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+    unsigned int now = pending_tick(), latency;
+
+    if (!power_model || (cpu->current == NULL) == (pcb == NULL))
+        return 0;
+
+    account_power(cpu_id, now);
+    if (pcb == NULL)
+    {
+        cpu->idle_since = now;
+        return 0;
+    }
+
+    if (now - cpu->idle_since >= deep_after)
+    {
+        idle_exits[POWER_DEEP]++;
+        latency = deep_exit;
+    }
+    else
+    {
+        idle_exits[POWER_SHALLOW]++;
+        latency = shallow_exit;
+    }
+    exit_latency += latency;
+    return latency;
+}
+
+/*
+ * account_power() charges CPU cpu_id with the energy it used, and the time
+ * it spent in each power state, up to tick now.
+ */
+static void account_power(unsigned int cpu_id, unsigned int now)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+    double scale = capacities[cpu_id] / 100.0, f;
+    unsigned int span, shallow, idle_before;
+
+    if (!power_model || now <= cpu->power_since)
+        return;
+
+    span = now - cpu->power_since;
+    if (cpu->current != NULL)
+    {
+        f = cpu->frequency / 100.0;
+        cpu->residency[POWER_ACTIVE] += span;
+        cpu->energy += span * scale * (MW_STATIC + MW_DYNAMIC * f * f * f);
+    }
+    else
+    {
+        /* Shallow idle until deep_after ticks in, deep idle from then on */
+        idle_before = cpu->power_since - cpu->idle_since;
+        shallow = idle_before < deep_after ? deep_after - idle_before : 0;
+        if (shallow > span)
+            shallow = span;
+        cpu->residency[POWER_SHALLOW] += shallow;
+        cpu->residency[POWER_DEEP] += span - shallow;
+        cpu->energy += scale * (shallow * MW_SHALLOW +
+            (span - shallow) * MW_DEEP);
+    }
+    cpu->power_since = now;
+}
+
+extern void set_topology(unsigned int new_sockets, unsigned int new_cores,
+                         unsigned int new_threads,
+                         unsigned int new_remote_penalty)
+{
+    sockets = new_sockets;
+    cores = new_cores;
+    threads = new_threads;
+    remote_penalty = new_remote_penalty;
+}
+
+extern void set_cpu_capacity(unsigned int cpu_id, unsigned int percent)
+{
+    assert(cpu_id < 16 && percent > 0);
+    capacities[cpu_id] = percent;
+}
+
+extern unsigned int cpu_capacity(unsigned int cpu_id)
+{
+    return capacities[cpu_id] != 0 ? capacities[cpu_id] : 100;
+}
+
+extern void set_power_states(unsigned int new_deep_after,
+                             unsigned int new_shallow_exit,
+                             unsigned int new_deep_exit)
+{
+    power_model = 1;
+    deep_after = new_deep_after;
+    shallow_exit = new_shallow_exit;
+    deep_exit = new_deep_exit;
+}
+
+extern void set_cpu_frequency(unsigned int cpu_id, unsigned int percent)
+{
+    assert(cpu_id < 16 && percent > 0 && percent <= 100);
+    __atomic_store_n(&frequencies[cpu_id], percent, __ATOMIC_RELAXED);
+}
+
+extern void set_cpu_parked(unsigned int cpu_id, int park)
+{
+    assert(cpu_id < 16);
+    __atomic_store_n(&parked[cpu_id], park != 0, __ATOMIC_RELAXED);
+}
+
+extern int cpu_parked(unsigned int cpu_id)
+{
+    return __atomic_load_n(&parked[cpu_id], __ATOMIC_RELAXED);
+}
+
+extern unsigned int node_count(void)
+{
+    return sockets;
+}
+
+extern unsigned int cpu_node(unsigned int cpu_id)
+{
+    return cpu_id / node_cpus;
+}
+
+extern int process_node(const pcb_t *pcb)
+{
+    return process_table[pcb->pid].home_node;
+}
+
+extern void set_switch_costs(unsigned int new_switch_cost,
+                             unsigned int new_migration_cost,
+                             unsigned int new_idle_cost)
+{
+    switch_cost = new_switch_cost;
+    migration_cost = new_migration_cost;
+    idle_cost = new_idle_cost;
+}
+
 extern void force_preempt(unsigned int cpu_id)
 {
     assert(cpu_id < cpu_count);
 
     IRWL_WRITER_UNLOCK(student_lock);
-    pthread_mutex_lock(&simulator_mutex);
+    PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
 
     /*
      * It is possible that the student's code calls force_preempt() at the
@@ -415,7 +1156,15 @@ extern void force_preempt(unsigned int cpu_id)
      */
     if (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
     {
+        if (simulator_cpu_data[cpu_id].timer.pending)
+        {
+            sync_cpu(cpu_id, pending_tick());
+            wheel_cancel(&simulator_cpu_data[cpu_id].timer);
+        }
         simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
+#ifdef PROFILE
+        simulator_cpu_data[cpu_id].preempt_stamp = profile_now();
+#endif
         pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
 
         /* Ensure the scheduler gets run before the simulator */
@@ -432,122 +1181,401 @@ extern void force_preempt(unsigned int cpu_id)
 /*
  * The functions below are used by the supervisor thread to simulate the OS.
  *
- * simulate_cpus() / simulate_process() simulate the processes on each CPU
- *   and signal the appropriate CPU thread if an event occurs.
+ * Nothing is simulated tick by tick.  Each CPU burst or time slice that is
+ * running, and the I/O request in service, has a timer on the timing wheel
+ * for the tick at which it ends; a tick only costs work for the timers that
+ * expire in it.
+ *
+ * simulate_events() handles this tick's expired timers.
+ *
+ * arm_cpu() / sync_cpu() set a CPU's timer for the process dispatched to
+ *   it, and charge that process's cursor with the ticks it has run.
+ *
+ * simulate_process() handles the end of a time slice or CPU burst and
+ *   signals the appropriate CPU thread.
  *
  * submit_io_request() inserts a PCB into tail of the I/O queue.
  *
- * simulate_io() simulates the I/O request at the head of the I/O queue and
- *   calls wake_up() upon completion.
+ * simulate_io() completes the I/O request at the head of the I/O queue and
+ *   calls wake_up().
  *
  * simulate_creat() simulates initial process creation by calling the
  *   student's wake_up().
  */
 
-static void simulate_cpus(void)
+/*
+ * pending_tick() is the first tick the CPUs have not run yet: the next one
+ * while the supervisor is working on a tick (or a handler it signalled is
+ * running), the current one otherwise.
+ */
+static unsigned int pending_tick(void)
 {
-    unsigned int n;
-
-    for (n=0; n<cpu_count; n++)
-    {
-        if (simulator_cpu_data[n].current != NULL)
-            simulate_process(n, simulator_cpu_data[n].current);
-    }
+    return in_tick ? simulator_time + 1 : simulator_time;
 }
 
-static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
+static void simulate_events(void)
 {
+    wheel_timer_t *timer;
+    unsigned int due_cpus = 0, n;
+    int io_due = 0;
+
     /*
-     * The "program counter" is really just a pointer to the current position
-     * in the operations array
+     * Collect the expired timers before handling any: the handlers re-arm
+     * them, which reuses their links.  CPUs are served in id order.
      */
-    op_t *pc = (op_t*)pcb->pc;
-
-    switch (pc->type)
+    for (timer = wheel_expire(&timers); timer != NULL; timer = timer->next)
     {
-    case OP_CPU:
-        /* Scheduling a running process ... good ... */
-
-        /* Check to see if the CPU burst has completed */
-        if (pc->time > 0)
-        {
-            /* Simulate running the process */
-            pc->time--;
-            pcb->time_remaining = pc->time + 1;
-            /* Simulate the preemption timer */
-            simulator_cpu_data[cpu_id].preemption_timer--;
-            if (simulator_cpu_data[cpu_id].preemption_timer == 0)
-            {
-                /* The timer has expired; preempt the running process */
-                simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
-            }
-        }
+        if (timer->owner == IO_TIMER)
+            io_due = 1;
         else
-        {
-            /* Move to the next operation */
-            pcb->pc=((op_t*)(pcb->pc))+1;
-            pc++;
-            pcb->time_remaining = pcb->pc->time + 1;
-            switch (pc->type)
-            {
-            case OP_IO:
-                /* Put a request in the I/O FIFO queue */
-                submit_io_request(pcb, pc->time);
+            due_cpus |= 1u << timer->owner;
+    }
 
-                /* Generate a yield() call on the appropriate CPU */
-                simulator_cpu_data[cpu_id].state = CPU_YIELD;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
+    while (due_cpus != 0)
+    {
+        n = (unsigned int)__builtin_ctz(due_cpus);
+        due_cpus &= due_cpus - 1;
+        simulate_process(n, simulator_cpu_data[n].current);
+    }
 
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+    /* A CPU may just have submitted an I/O request that takes no time */
+    for (timer = wheel_expire(&timers); timer != NULL; timer = timer->next)
+    {
+        assert(timer->owner == IO_TIMER);
+        io_due = 1;
+    }
 
-                break;
+    /* Threads a barrier has let through, and processes handed a lock */
+    for (n=0; n<released_count; n++)
+        wake_process(pcb_of(released[n]));
+    released_count = 0;
 
-            case OP_TERMINATE:
-                /* Generate a terminate() call on the appropriate CPU */
-                simulator_cpu_data[cpu_id].state = CPU_TERMINATE;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
+    if (io_due)
+        simulate_io();
+}
 
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+/*
+ * arm_cpu() sets the timer of CPU cpu_id for the process just dispatched to
+ * it.  The process starts on the first tick the CPU has not run and is done
+ * paying for the switch.  The timer expires on the tick its time slice runs
+ * out or, if its burst is shorter, on the tick after the burst, when it
+ * moves on to its next operation.
+ */
+static void arm_cpu(unsigned int cpu_id)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+    pcb_t *pcb = cpu->current;
+    unsigned int start = pending_tick(), need, frequency;
+    int home;
 
-                break;
+    if (pcb == NULL)
+        return;
 
-            case OP_CPU:
-                break;
-            }
-        }
+    switch (program[pcb->pid][cursor[pcb->pid].op].type)
+    {
+    case OP_CPU:
+        /* Scheduling a runnable process ... good ... */
         break;
 
     case OP_IO:
         /* Scheduling a process that's blocked on I/O */
         printf("Scheduled a process that's blocked on I/0! PID: %d\n", pcb->pid);
-        break;
+        return;
 
     case OP_TERMINATE:
         /* Scheduling a process that's terminated */
         printf("Scheduled a terminated process! PID: %d\n", pcb->pid);
-        break;
+        return;
+
+    case OP_BARRIER:
+        /* Scheduling a thread that's waiting at a barrier */
+        printf("Scheduled a thread waiting at a barrier! PID: %d\n",
+            pcb->pid);
+        return;
+
+    case OP_LOCK:
+    case OP_UNLOCK:
+        /* Scheduling a process that's waiting for a lock */
+        printf("Scheduled a process waiting for a lock! PID: %d\n",
+            pcb->pid);
+        return;
     }
-}
 
-static void submit_io_request(pcb_t *pcb, unsigned int execution_time)
-{
-    io_request *r;
+    if (cpu->penalty_until > start)
+        start = cpu->penalty_until;
+    cpu->work_start = start;
 
-    /* Build I/O Request */
-    r = malloc(sizeof(io_request));
-    assert(r != NULL);
-    r->pcb = pcb;
-    r->execution_time = execution_time;
-    r->next = NULL;
+    /* A new frequency takes effect from here */
+    frequency = __atomic_load_n(&frequencies[cpu_id], __ATOMIC_RELAXED);
+    if (frequency == 0)
+        frequency = 100;
+    if (frequency != cpu->frequency)
+    {
+        account_power(cpu_id, pending_tick());
+        cpu->frequency = frequency;
+    }
+
+    /*
+     * A process gets its CPU's capacity done per tick, at its frequency,
+     * less away from its memory
+     */
+    home = process_table[pcb->pid].home_node;
+    cpu->remote = home >= 0 && (unsigned int)home != cpu_node(cpu_id);
+    cpu->rate = RATE_ONE * capacities[cpu_id] * frequency /
+        (100 * (cpu->remote ? 100 + remote_penalty : 100));
+
+    need = burst_ticks(cpu, &cursor[pcb->pid]);
+    if (cpu->preemption_timer > 0 &&
+        (unsigned int)cpu->preemption_timer <= need)
+        wheel_add(&timers, &cpu->timer,
+            start + (unsigned int)cpu->preemption_timer - 1);
+    else
+        wheel_add(&timers, &cpu->timer, start + need);
+}
+
+/*
+ * burst_ticks() is the number of ticks, from its work_start, that CPU cpu
+ * needs to finish the burst at pc.
+ */
+static unsigned int burst_ticks(const simulator_cpu_data_t *cpu,
+                                const op_cursor_t *pc)
+{
+    unsigned long work;
+
+    if (pc->remaining == 0)
+        return 0;
+    work = (unsigned long)pc->remaining * RATE_ONE - pc->partial;
+    return (unsigned int)((work + cpu->rate - 1) / cpu->rate);
+}
+
+/*
+ * sync_cpu() charges the process on CPU cpu_id, and its time slice, with
+ * the ticks it has run before tick now.  The timer stays where it is.
+ */
+static void sync_cpu(unsigned int cpu_id, unsigned int now)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+    pcb_t *pcb = cpu->current;
+    op_cursor_t *pc = &cursor[pcb->pid];
+    unsigned int ran, need;
+    unsigned long work;
+
+    if (now <= cpu->work_start)
+        return;
+
+    ran = now - cpu->work_start;
+    need = burst_ticks(cpu, pc);
+    if (ran > need)
+        ran = need;
+    cpu->work_start = now;
+    if (ran == 0)
+        return;
+
+    if (ran == need)
+    {
+        pc->remaining = 0;
+        pc->partial = 0;
+    }
+    else
+    {
+        work = (unsigned long)ran * cpu->rate + pc->partial;
+        pc->remaining -= (unsigned int)(work / RATE_ONE);
+        pc->partial = (unsigned int)(work % RATE_ONE);
+    }
+    pcb->time_remaining = pc->remaining + 1;
+    cpu->preemption_timer -= (int)ran;
+    cpu->busy_ticks += ran;
+
+    if (cpu->remote)
+        remote_ticks += ran;
+    else
+        local_ticks += ran;
+}
+
+/*
+ * sync_running() brings every running process up to date, so that the
+ * student's wake_up() sees their true remaining times.
+ */
+static void sync_running(void)
+{
+    unsigned int n;
+
+    for (n=0; n<cpu_count; n++)
+    {
+        if (simulator_cpu_data[n].timer.pending)
+            sync_cpu(n, pending_tick());
+    }
+}
+
+/*
+ * settle() makes the deterministic mode deterministic.  Normally a CPU
+ * waits in idle() until a process is ready, and picks it up whenever its
+ * thread gets to run; several idle CPUs race for it, and a waiting CPU can
+ * even take the process a preempt() handler has just put back.
+ *
+ * In deterministic mode idle CPUs wait in the simulator instead.  After
+ * each wake_up(), which always leaves a process ready, the supervisor
+ * calls settle() to let the lowest numbered idle CPU into idle(), and
+ * waits until that CPU has dispatched.  Called with the simulator_mutex
+ * held.
+ */
+static void settle(void)
+{
+    unsigned int n;
+
+    if (!deterministic)
+        return;
+
+    for (n=0; n<cpu_count; n++)
+        if (simulator_cpu_data[n].current == NULL &&
+            !__atomic_load_n(&parked[n], __ATOMIC_RELAXED))
+            break;
+    if (n == cpu_count)
+        return;
+
+    idle_turn = n;
+    pthread_cond_signal(&simulator_cpu_data[n].wakeup);
+    while (simulator_cpu_data[n].current == NULL)
+        pthread_cond_wait(&settled, &simulator_mutex);
+    idle_turn = cpu_count;
+}
+
+static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+    simulator_process_t *group;
+    const op_t *pc;
+    unsigned int n;
+
+    /*
+     * The "program counter" is a cursor into the process's read-only
+     * operations array: the current operation and the ticks left in it
+     */
+    if (cpu->preemption_timer > 0 &&
+        (unsigned int)cpu->preemption_timer <=
+        burst_ticks(cpu, &cursor[pcb->pid]))
+    {
+        /* The timer expires with this tick; preempt the running process */
+        sync_cpu(cpu_id, simulator_time + 1);
+        cpu->state = CPU_PREEMPT;
+        pthread_cond_signal(&cpu->wakeup);
+
+        /* Ensure the scheduler gets run before the simulator */
+        pthread_cond_wait(&cpu->wakeup, &simulator_mutex);
+        return;
+    }
+
+    /* The CPU burst has completed; move to the next operation */
+    sync_cpu(cpu_id, simulator_time);
+    pc = advance_pc(pcb);
+    switch (pc->type)
+    {
+    case OP_IO:
+        /* Put a request in the I/O FIFO queue */
+        submit_io_request(pcb, cursor[pcb->pid].remaining);
+
+        /* Generate a yield() call on the appropriate CPU */
+        cpu->state = CPU_YIELD;
+        pthread_cond_signal(&cpu->wakeup);
+
+        /* Ensure the scheduler gets run before the simulator */
+        pthread_cond_wait(&cpu->wakeup, &simulator_mutex);
+        break;
+
+    case OP_BARRIER:
+        if (arrive_barrier(pcb))
+        {
+            /* The last thread to arrive goes straight on to its next burst */
+            pc = advance_pc(pcb);
+            assert(pc->type == OP_CPU);
+            arm_cpu(cpu_id);
+            break;
+        }
+
+        /* Generate a yield() call on the appropriate CPU */
+        cpu->state = CPU_YIELD;
+        pthread_cond_signal(&cpu->wakeup);
+
+        /* Ensure the scheduler gets run before the simulator */
+        pthread_cond_wait(&cpu->wakeup, &simulator_mutex);
+        break;
+
+    case OP_LOCK:
+        if (acquire_lock(pcb, pc->time))
+        {
+            pc = advance_pc(pcb);
+            assert(pc->type == OP_CPU);
+            arm_cpu(cpu_id);
+            break;
+        }
+
+        /* Generate a yield() call on the appropriate CPU */
+        cpu->state = CPU_YIELD;
+        pthread_cond_signal(&cpu->wakeup);
+
+        /* Ensure the scheduler gets run before the simulator */
+        pthread_cond_wait(&cpu->wakeup, &simulator_mutex);
+        break;
+
+    case OP_UNLOCK:
+        /* The next waiter, if any, takes the lock and is woken up */
+        release_lock(pcb->pid, pc->time);
+        pc = advance_pc(pcb);
+        assert(pc->type == OP_CPU);
+        arm_cpu(cpu_id);
+        break;
+
+    case OP_TERMINATE:
+        /* Locks still held are released */
+        for (n=0; n<RESOURCE_COUNT; n++)
+            if (resources[n].holder == pcb->pid)
+                release_lock(pcb->pid, n);
+
+        /* The threads still at a barrier no longer wait for this one */
+        group = &process_table[process_table[pcb->pid].group];
+        group->live_threads--;
+        if (group->at_barrier > 0 && group->at_barrier == group->live_threads)
+            open_barrier(process_table[pcb->pid].group);
+
+        /* Generate a terminate() call on the appropriate CPU */
+        cpu->state = CPU_TERMINATE;
+        pthread_cond_signal(&cpu->wakeup);
+
+        /* Ensure the scheduler gets run before the simulator */
+        pthread_cond_wait(&cpu->wakeup, &simulator_mutex);
+        break;
+
+    case OP_CPU:
+        /* Another burst: it keeps the CPU and what is left of its slice */
+        arm_cpu(cpu_id);
+        break;
+    }
+}
+
+/*
+ * advance_pc() moves a process's cursor to its next operation and loads the
+ * ticks of that operation.  The operations array itself is never written.
+ */
+static const op_t *advance_pc(pcb_t *pcb)
+{
+    const op_t *pc = &program[pcb->pid][++cursor[pcb->pid].op];
+
+    cursor[pcb->pid].remaining = pc->time;
+    cursor[pcb->pid].partial = 0;
+    pcb->time_remaining = pc->time + 1;
+    return pc;
+}
+
+static void submit_io_request(pcb_t *pcb, unsigned int execution_time)
+{
+    io_request *r;
+
+    /* Build I/O Request */
+    r = malloc(sizeof(io_request));
+    assert(r != NULL);
+    r->pcb = pcb;
+    r->execution_time = execution_time;
+    r->next = NULL;
 
     /* Add request to head of queue */
     if (io_queue_tail != NULL)
@@ -557,62 +1585,1087 @@ static void submit_io_request(pcb_t *pcb, unsigned int execution_time)
     }
     else
     {
+        /* The device is free: the request is serviced from this tick on */
         io_queue_head = r;
         io_queue_tail = r;
+        wheel_add(&timers, &io_timer, simulator_time + execution_time);
     }
 }
 
 static void simulate_io(void)
 {
+    io_request *completed = io_queue_head;
+    pcb_t *pcb;
+
+    /* Move the programs "PC" to the next "instruction" */
+    advance_pc(completed->pcb);
+
+    /*
+     * Remove the I/O request from the queue before calling the student's
+     * code.  We must do this, because once we release the simulator_mutex,
+     * the I/O queue may have changed.  The next request is serviced from
+     * the next tick on.
+     */
+    pcb = completed->pcb;
+    io_queue_head = completed->next;
     if (io_queue_head == NULL)
-        return; /* There are no I/O requests */
+        io_queue_tail = NULL;
+    else
+        wheel_add(&timers, &io_timer,
+            simulator_time + 1 + io_queue_head->execution_time);
+    free(completed);
 
-    if (io_queue_head->execution_time-- <= 0)
+    wake_process(pcb);
+}
+
+/*
+ * simulate_creat() releases this tick's arrivals.  The closed workload
+ * creates the processes of its table one per second; the open models spawn
+ * new processes until max_arrivals is reached.
+ */
+static void simulate_creat(void)
+{
+    unsigned int n, arrivals = 0;
+
+    switch (arrival_kind)
     {
-        io_request *completed = io_queue_head;
-        pcb_t *pcb;
+    case ARRIVAL_CLOSED:
+        if ((simulator_time % 10) == 0 && processes_created < workload_count())
+        {
+            processes_created++;
+            create_process(pcb_of(
+                closed_leader[creation_order[processes_created - 1]]));
+        }
+        return;
 
-        /* Move the programs "PC" to the next "instruction" */
-        completed->pcb->pc = ((op_t*)completed->pcb->pc) + 1;
-        completed->pcb->time_remaining = completed->pcb->pc->time + 1;
+    case ARRIVAL_POISSON:
+        arrivals = poisson_arrivals();
+        break;
 
-        /*
-         * Remove the I/O request from the queue before calling the student's
-         * code.  We must do this, because once we release the simulator_mutex,
-         * the I/O queue may have changed.
-         */
-        pcb = completed->pcb;
-        io_queue_head = completed->next;
-        if (io_queue_head == NULL)
-            io_queue_tail = NULL;
-        free(completed);
+    case ARRIVAL_ONOFF:
+        if (simulator_time % (onoff_on + onoff_off) < onoff_on)
+            arrivals = poisson_arrivals();
+        break;
 
-        /* Call the student's wake_up() handler */
-        pthread_mutex_unlock(&simulator_mutex);
-        IRWL_WRITER_LOCK(student_lock);
-        wake_up(pcb);
-        IRWL_WRITER_UNLOCK(student_lock);
-        pthread_mutex_lock(&simulator_mutex);
+    case ARRIVAL_TRACE:
+        while (processes_created < trace_count &&
+               trace[processes_created].time <= simulator_time &&
+               (max_arrivals == 0 || processes_created < max_arrivals))
+            create_process(spawn_process(trace[processes_created].program));
+        return;
+    }
+
+    for (n=0; n<arrivals; n++)
+    {
+        if (max_arrivals != 0 && processes_created >= max_arrivals)
+            break;
+        create_process(spawn_process(-1));
     }
 }
 
-static void simulate_creat(void)
+/*
+ * create_process() hands a new process, every one of its threads, to the
+ * student's wake_up() handler.  Called with the simulator_mutex held.
+ */
+static void create_process(pcb_t *pcb)
 {
-    static int processes_created = 0;
+    unsigned int pid, last = pcb->pid + process_table[pcb->pid].threads;
 
-    if ((simulator_time % 10) == 0 && processes_created < PROCESS_COUNT)
+    if (arrival_kind != ARRIVAL_CLOSED)
+        processes_created++;
+    for (pid = pcb->pid; pid < last; pid++)
     {
-        /* Call student's wake_up() handler */
-        pthread_mutex_unlock(&simulator_mutex);
-        IRWL_WRITER_LOCK(student_lock);
-        wake_up(&processes[processes_created]);
-        IRWL_WRITER_UNLOCK(student_lock);
-        pthread_mutex_lock(&simulator_mutex);
+        process_table[pid].arrival_time = simulator_time;
+        wake_process(pcb_of(pid));
+    }
+}
 
-        processes_created++;
+/*
+ * wake_process() calls the student's wake_up() handler for a process that
+ * has become ready.  Called with the simulator_mutex held, which is
+ * dropped while the handler runs.
+ */
+static void wake_process(pcb_t *pcb)
+{
+    PROFILE_DECLARE(start);
+
+    sync_running();
+    pthread_mutex_unlock(&simulator_mutex);
+    IRWL_WRITER_LOCK(student_lock);
+    PROFILE_STAMP(start);
+    wake_up(pcb);
+    PROFILE_RECORD(PROFILE_WAKE_UP, start);
+    IRWL_WRITER_UNLOCK(student_lock);
+    PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
+    settle();
+}
+
+/*
+ * spawn_process() makes a new process running entry which of the workload,
+ * or a random entry if which is negative, and returns its first thread.
+ * Called with the simulator_mutex held (or before the simulation starts).
+ */
+static pcb_t *spawn_process(int which)
+{
+    unsigned int thread, count = 1;
+    pcb_t *pcb;
+
+    if (which < 0)
+        which = (int)(next_random() % workload_count());
+    if (threaded)
+        count = threaded_processes[which].threads;
+
+    pcb = spawn_thread((unsigned int)which, 0);
+    for (thread=1; thread<count; thread++)
+        spawn_thread((unsigned int)which, thread);
+    process_table[pcb->pid].live_threads = count;
+    return pcb;
+}
+
+/*
+ * spawn_thread() adds thread thread of entry model of the workload to the
+ * process table under the next pid; any thread but the first joins the
+ * process of the pid before it.  The program itself is shared, not copied.
+ */
+static pcb_t *spawn_thread(unsigned int model, unsigned int thread)
+{
+    const program_t entry = workload_program(model, thread);
+    unsigned int pid = process_count;
+    pcb_t *pcb;
+
+    if (pid == process_capacity)
+    {
+        process_capacity = process_capacity ? process_capacity * 2 : 64;
+        process_table = realloc(process_table,
+            sizeof(simulator_process_t) * process_capacity);
+        assert(process_table != NULL);
+        program = realloc(program, sizeof(const op_t *) * process_capacity);
+        assert(program != NULL);
+        cursor = realloc(cursor, sizeof(op_cursor_t) * process_capacity);
+        assert(cursor != NULL);
+        live = realloc(live, sizeof(unsigned int) * process_capacity);
+        assert(live != NULL);
+        turnaround = realloc(turnaround,
+            sizeof(unsigned int) * process_capacity);
+        assert(turnaround != NULL);
+        released = realloc(released, sizeof(unsigned int) * process_capacity);
+        assert(released != NULL);
     }
+    if ((pid & (PCB_CHUNK - 1)) == 0)
+    {
+        void *chunk;
+
+        pcb_chunk = realloc(pcb_chunk,
+            sizeof(pcb_t *) * ((pid >> PCB_CHUNK_SHIFT) + 1));
+        assert(pcb_chunk != NULL);
+        if (posix_memalign(&chunk, 64, sizeof(pcb_t) * PCB_CHUNK) != 0)
+            chunk = NULL;
+        assert(chunk != NULL);
+        pcb_chunk[pid >> PCB_CHUNK_SHIFT] = chunk;
+    }
+
+    {
+        pcb_t init = {
+            .pid = pid,
+            .state = PROCESS_NEW,
+            .next = PID_NONE,
+            .time_remaining = entry.ops[0].time,
+            .priority = entry.priority,
+            .deadline = entry.deadline
+        };
+
+        pcb = pcb_of(pid);
+        memcpy(pcb, &init, sizeof(pcb_t));
+    }
+
+    process_table[pid].name = entry.name;
+    process_table[pid].last_cpu = -1;
+    process_table[pid].home_node = -1;
+    process_table[pid].arrival_time = 0;
+    process_table[pid].model = model;
+    process_table[pid].thread = thread;
+    process_table[pid].group = pid - thread;
+    process_table[pid].threads = 1;
+    process_table[pid].live_threads = 1;
+    process_table[pid].at_barrier = 0;
+    process_table[pid].in_barrier = 0;
+    process_table[pid].barrier_since = 0;
+    process_table[pid].blocked_on = NO_RESOURCE;
+    process_table[pid].lock_next = PID_NONE;
+    process_table[pid].lock_since = 0;
+    process_table[pid].inverted = 0;
+    process_table[pid].waiters = 0;
+    process_table[pid].waiters_low = 0;
+    process_table[pid].waiters_high = 0;
+    if (thread > 0)
+        process_table[pid - thread].threads++;
+    else if (arrival_kind == ARRIVAL_CLOSED)
+        closed_leader[model] = pid;
+    program[pid] = entry.ops;
+    cursor[pid].op = 0;
+    cursor[pid].remaining = entry.ops[0].time;
+    cursor[pid].partial = 0;
+    live[live_count++] = pid;
+    process_count++;
+    return pcb;
+}
+
+extern pcb_t *pcb_of(unsigned int pid)
+{
+    return &pcb_chunk[pid >> PCB_CHUNK_SHIFT][pid & (PCB_CHUNK - 1)];
+}
+
+extern unsigned int pid_count(void)
+{
+    return process_count;
+}
+
+extern const char *process_name(const pcb_t *pcb)
+{
+    return process_table[pcb->pid].name;
+}
+
+extern unsigned int thread_group(const pcb_t *pcb)
+{
+    return process_table[pcb->pid].group;
+}
+
+extern unsigned int thread_count(const pcb_t *pcb)
+{
+    return process_table[process_table[pcb->pid].group].threads;
+}
+
+extern unsigned int lock_holder(const pcb_t *pcb)
+{
+    unsigned int resource = __atomic_load_n(
+        &process_table[pcb->pid].blocked_on, __ATOMIC_RELAXED);
+
+    if (resource == NO_RESOURCE)
+        return PID_NONE;
+    return __atomic_load_n(&resources[resource].holder, __ATOMIC_RELAXED);
+}
+
+extern unsigned int lock_waiters(const pcb_t *pcb, unsigned int *lowest,
+                                 unsigned int *highest)
+{
+    simulator_process_t *process = &process_table[pcb->pid];
+
+    *lowest = __atomic_load_n(&process->waiters_low, __ATOMIC_RELAXED);
+    *highest = __atomic_load_n(&process->waiters_high, __ATOMIC_RELAXED);
+    return __atomic_load_n(&process->waiters, __ATOMIC_RELAXED);
+}
+
+extern void set_threaded_workload(int enable)
+{
+    threaded = enable;
 }
 
+/* workload_count() is the number of entries in the workload's table */
+static unsigned int workload_count(void)
+{
+    return threaded ? THREADED_COUNT : PROCESS_COUNT;
+}
+
+/*
+ * workload_program() returns the name, priority, deadline and program of
+ * thread thread of entry model of the workload.
+ */
+static program_t workload_program(unsigned int model, unsigned int thread)
+{
+    program_t entry;
+
+    if (!threaded)
+        return processes[model];
+
+    entry.name = threaded_processes[model].name;
+    entry.priority = threaded_processes[model].priority;
+    entry.deadline = threaded_processes[model].deadline;
+    entry.ops = threaded_processes[model].ops[thread];
+    return entry;
+}
+
+/*
+ * arrive_barrier() records a thread's arrival at a barrier.  It returns 1
+ * if the thread is the last of its process to get there, having let the
+ * others through, or 0 if it must wait.  Called with the simulator_mutex
+ * held.
+ */
+static int arrive_barrier(pcb_t *pcb)
+{
+    simulator_process_t *thread = &process_table[pcb->pid];
+    simulator_process_t *group = &process_table[thread->group];
+
+    barrier_waits++;
+    if (group->at_barrier + 1 == group->live_threads)
+    {
+        open_barrier(thread->group);
+        return 1;
+    }
+
+    group->at_barrier++;
+    thread->in_barrier = 1;
+    thread->barrier_since = simulator_time;
+    return 0;
+}
+
+/*
+ * open_barrier() moves every thread of process group waiting at its barrier
+ * past it, and queues them up for wake_up().  Called with the
+ * simulator_mutex held.
+ */
+static void open_barrier(unsigned int group)
+{
+    unsigned int pid, waited;
+
+    for (pid=group; pid<group+process_table[group].threads; pid++)
+    {
+        if (!process_table[pid].in_barrier)
+            continue;
+
+        waited = simulator_time - process_table[pid].barrier_since;
+        barrier_ticks += waited;
+        if (waited > barrier_max)
+            barrier_max = waited;
+        process_table[pid].in_barrier = 0;
+        advance_pc(pcb_of(pid));
+        released[released_count++] = pid;
+    }
+    process_table[group].at_barrier = 0;
+}
+
+/*
+ * acquire_lock() takes resource for a process at an OP_LOCK.  It returns 1
+ * if the resource was free, or 0 if the process must wait for it at the
+ * tail of its queue.  Called with the simulator_mutex held.
+ */
+static int acquire_lock(pcb_t *pcb, unsigned int resource)
+{
+    resource_t *r = &resources[resource];
+    simulator_process_t *process = &process_table[pcb->pid];
+    unsigned int holder;
+
+    assert(resource < RESOURCE_COUNT);
+    r->acquisitions++;
+    if (r->holder == PID_NONE)
+    {
+        __atomic_store_n(&r->holder, pcb->pid, __ATOMIC_RELAXED);
+        r->held_since = simulator_time;
+        return 1;
+    }
+
+    /* A program that waits on itself, through any chain, is deadlocked */
+    for (holder = r->holder; ; holder =
+         resources[process_table[holder].blocked_on].holder)
+    {
+        assert(holder != pcb->pid);
+        if (process_table[holder].blocked_on == NO_RESOURCE)
+            break;
+    }
+
+    r->contended++;
+    process->lock_next = PID_NONE;
+    process->lock_since = simulator_time;
+    process->inverted = 0;
+    if (r->tail != PID_NONE)
+        process_table[r->tail].lock_next = pcb->pid;
+    else
+        r->head = pcb->pid;
+    r->tail = pcb->pid;
+    __atomic_store_n(&process->blocked_on, resource, __ATOMIC_RELAXED);
+    update_inheritance(r->holder);
+    return 0;
+}
+
+/*
+ * release_lock() frees resource, held by process pid.  The process at the
+ * head of its queue, if any, takes it, moves past its OP_LOCK and is
+ * queued up for wake_up().  Called with the simulator_mutex held.
+ */
+static void release_lock(unsigned int pid, unsigned int resource)
+{
+    resource_t *r = &resources[resource];
+    simulator_process_t *waiter;
+    unsigned int next = r->head;
+
+    assert(resource < RESOURCE_COUNT && r->holder == pid);
+    record_time(&hold_times, &hold_count, simulator_time - r->held_since);
+    __atomic_store_n(&r->holder, next, __ATOMIC_RELAXED);
+    if (next != PID_NONE)
+    {
+        waiter = &process_table[next];
+        r->head = waiter->lock_next;
+        if (r->head == PID_NONE)
+            r->tail = PID_NONE;
+        r->held_since = simulator_time;
+
+        record_time(&wait_times, &wait_count,
+            simulator_time - waiter->lock_since);
+        if (waiter->inverted > 0)
+        {
+            inversions++;
+            inversion_ticks += waiter->inverted;
+            if (waiter->inverted > inversion_max)
+                inversion_max = waiter->inverted;
+        }
+        __atomic_store_n(&waiter->blocked_on, NO_RESOURCE, __ATOMIC_RELAXED);
+        advance_pc(pcb_of(next));
+        released[released_count++] = next;
+
+        /* The rest of the queue now waits on the new holder */
+        update_inheritance(next);
+    }
+    update_inheritance(pid);
+}
+
+/*
+ * update_inheritance() recounts the processes waiting on the locks process
+ * pid holds, and the range of their priorities, then does the same for
+ * the holder of the lock pid itself waits for, up the chain.  Called with
+ * the simulator_mutex held.
+ */
+static void update_inheritance(unsigned int pid)
+{
+    simulator_process_t *process = &process_table[pid], *waiter;
+    unsigned int r, next, count = 0, low = ~0u, high = 0, priority;
+
+    for (r=0; r<RESOURCE_COUNT; r++)
+    {
+        if (resources[r].holder != pid)
+            continue;
+        for (next = resources[r].head; next != PID_NONE;
+             next = waiter->lock_next)
+        {
+            waiter = &process_table[next];
+            priority = pcb_of(next)->priority;
+            count++;
+            if (priority < low)
+                low = priority;
+            if (priority > high)
+                high = priority;
+            if (waiter->waiters > 0)
+            {
+                count += waiter->waiters;
+                if (waiter->waiters_low < low)
+                    low = waiter->waiters_low;
+                if (waiter->waiters_high > high)
+                    high = waiter->waiters_high;
+            }
+        }
+    }
+    if (count == 0)
+        low = 0;
+
+    __atomic_store_n(&process->waiters, count, __ATOMIC_RELAXED);
+    __atomic_store_n(&process->waiters_low, low, __ATOMIC_RELAXED);
+    __atomic_store_n(&process->waiters_high, high, __ATOMIC_RELAXED);
+    if (process->blocked_on != NO_RESOURCE)
+        update_inheritance(resources[process->blocked_on].holder);
+}
+
+/* record_time() appends ticks to a growable array of times */
+static void record_time(unsigned int **times, unsigned int *count,
+                        unsigned int ticks)
+{
+    if (*count % TIMES_CHUNK == 0)
+    {
+        *times = realloc(*times, sizeof(unsigned int) *
+            (*count + TIMES_CHUNK));
+        assert(*times != NULL);
+    }
+    (*times)[(*count)++] = ticks;
+}
+
+/* print_times() prints the distribution of an array of times, if any */
+static void print_times(const char *what, unsigned int *times,
+                        unsigned int count)
+{
+    unsigned long total = 0;
+    unsigned int n;
+
+    if (count == 0)
+        return;
+    qsort(times, count, sizeof(unsigned int), compare_uint);
+    for (n=0; n<count; n++)
+        total += times[n];
+    printf("%s: %u, mean %.2f s, p50 %.1f s, p95 %.1f s, max %.1f s\n",
+        what, count, (double)total / count / 10.0,
+        (float)times[(count - 1) * 50 / 100] / 10.0,
+        (float)times[(count - 1) * 95 / 100] / 10.0,
+        (float)times[count - 1] / 10.0);
+}
+
+/*
+ * poisson_arrivals() draws the number of arrivals in one tick (Knuth's
+ * method; the per-tick rate is small).
+ */
+static unsigned int poisson_arrivals(void)
+{
+    double limit = exp(-arrival_rate), p = 1.0;
+    unsigned int k = 0;
+
+    do
+    {
+        k++;
+        p *= ((double)(next_random() >> 8) + 1.0) / 16777217.0;
+    } while (p > limit);
+
+    return k - 1;
+}
+
+/* xorshift32, seeded from the workload seed */
+static uint32_t next_random(void)
+{
+    arrival_random ^= arrival_random << 13;
+    arrival_random ^= arrival_random >> 17;
+    arrival_random ^= arrival_random << 5;
+    return arrival_random;
+}
+
+/*
+ * simulation_done() is true once every process that will ever arrive has
+ * terminated, or the horizon is reached.
+ */
+static int simulation_done(void)
+{
+    unsigned int expected;
+
+    if (horizon != 0 && simulator_time >= horizon)
+        return 1;
+
+    switch (arrival_kind)
+    {
+    case ARRIVAL_CLOSED:
+        expected = workload_count();
+        break;
+    case ARRIVAL_TRACE:
+        expected = (max_arrivals != 0 && max_arrivals < trace_count) ?
+            max_arrivals : trace_count;
+        break;
+    default:
+        if (max_arrivals == 0)
+            return 0;
+        expected = max_arrivals;
+        break;
+    }
+
+    return processes_created >= expected && processes_terminated >= expected;
+}
+
+static int compare_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+
+    return (x > y) - (x < y);
+}
+
+extern int set_arrival_model(const char *spec, unsigned int new_max_arrivals,
+                             unsigned int new_horizon)
+{
+    double rate;
+
+    max_arrivals = new_max_arrivals;
+    horizon = new_horizon;
+
+    if (sscanf(spec, "poisson:%lf", &rate) == 1 && rate > 0)
+    {
+        arrival_kind = ARRIVAL_POISSON;
+    }
+    else if (sscanf(spec, "onoff:%lf:%u:%u", &rate, &onoff_on,
+                    &onoff_off) == 3 && rate > 0 && onoff_on > 0)
+    {
+        arrival_kind = ARRIVAL_ONOFF;
+    }
+    else if (strncmp(spec, "trace:", 6) == 0)
+    {
+        FILE *f = fopen(spec + 6, "r");
+        char line[256], name[64];
+        unsigned int capacity = 0, n;
+
+        if (f == NULL)
+        {
+            perror(spec + 6);
+            return -1;
+        }
+        while (fgets(line, sizeof(line), f) != NULL)
+        {
+            int fields = sscanf(line, "%u %63s", &n, name);
+
+            if (fields < 1)
+                continue;
+            if (trace_count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 64;
+                trace = realloc(trace, sizeof(trace_arrival_t) * capacity);
+                assert(trace != NULL);
+            }
+            trace[trace_count].time = n;
+            trace[trace_count].program = -1;
+            for (n=0; fields == 2 && n<workload_count(); n++)
+            {
+                if (strcmp(workload_program(n, 0).name, name) == 0)
+                    trace[trace_count].program = (int)n;
+            }
+            if (trace_count > 0 && trace[trace_count].time <
+                trace[trace_count - 1].time)
+            {
+                fprintf(stderr, "%s: arrivals must be in time order\n",
+                    spec + 6);
+                fclose(f);
+                return -1;
+            }
+            trace_count++;
+        }
+        fclose(f);
+        arrival_kind = ARRIVAL_TRACE;
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
+
+    /* A Poisson stream with neither bound would never end */
+    if (max_arrivals == 0 && horizon == 0)
+        return -1;
+
+    arrival_rate = rate / 10.0;
+    return 0;
+}
+
+
+/*
+ * shuffle_creation_order() fills creation_order[] with a Fisher-Yates
+ * shuffle driven by a xorshift generator, so a seed always gives the same
+ * order regardless of the host's libc.
+ */
+static void shuffle_creation_order(void)
+{
+    unsigned int n, k, tmp;
+    uint32_t x = workload_seed;
+
+    for (n=0; n<workload_count(); n++)
+        creation_order[n] = n;
+
+    if (workload_seed == 0)
+        return;
+
+    for (n=workload_count()-1; n>0; n--)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        k = x % (n + 1);
+        tmp = creation_order[n];
+        creation_order[n] = creation_order[k];
+        creation_order[k] = tmp;
+    }
+}
+
+/*
+ * save_checkpoint() writes the state of the simulation at the start of this
+ * tick to checkpoint_path: the clock and counters, every process with its
+ * PCB and program counter, the CPUs and their timers, the I/O queue, and
+ * then the scheduler's own state from save_scheduler().  In deterministic
+ * mode every CPU thread is parked between ticks, so nothing moves while it
+ * is written.  Called with the simulator_mutex held.
+ */
+static void save_checkpoint(void)
+{
+    FILE *f = fopen(checkpoint_path, "wb");
+    unsigned int magic = CHECKPOINT_MAGIC, version = CHECKPOINT_VERSION;
+    unsigned int kind = (unsigned int)arrival_kind;
+    unsigned int n, pid, io_count = 0;
+    io_request *r;
+    int saved;
+
+    if (f == NULL)
+    {
+        perror(checkpoint_path);
+        return;
+    }
+
+    CHECKPOINT_SAVE(f, magic);
+    CHECKPOINT_SAVE(f, version);
+    CHECKPOINT_SAVE(f, cpu_count);
+    CHECKPOINT_SAVE(f, kind);
+    CHECKPOINT_SAVE(f, threaded);
+    CHECKPOINT_SAVE(f, simulator_time);
+    CHECKPOINT_SAVE(f, processes_terminated);
+    CHECKPOINT_SAVE(f, processes_created);
+    CHECKPOINT_SAVE(f, ready_counter);
+    CHECKPOINT_SAVE(f, running_counter);
+    CHECKPOINT_SAVE(f, waiting_counter);
+    CHECKPOINT_SAVE(f, context_switches);
+    CHECKPOINT_SAVE(f, switch_overhead);
+    CHECKPOINT_SAVE(f, migrations);
+    CHECKPOINT_SAVE(f, local_ticks);
+    CHECKPOINT_SAVE(f, remote_ticks);
+    CHECKPOINT_SAVE(f, remote_dispatches);
+    CHECKPOINT_SAVE(f, idle_exits);
+    CHECKPOINT_SAVE(f, exit_latency);
+    CHECKPOINT_SAVE(f, barrier_waits);
+    CHECKPOINT_SAVE(f, barrier_max);
+    CHECKPOINT_SAVE(f, barrier_ticks);
+    CHECKPOINT_SAVE(f, resources);
+    CHECKPOINT_SAVE(f, inversions);
+    CHECKPOINT_SAVE(f, inversion_max);
+    CHECKPOINT_SAVE(f, inversion_ticks);
+    CHECKPOINT_SAVE(f, hold_count);
+    CHECKPOINT_SAVE_ARRAY(f, hold_times, hold_count);
+    CHECKPOINT_SAVE(f, wait_count);
+    CHECKPOINT_SAVE_ARRAY(f, wait_times, wait_count);
+    CHECKPOINT_SAVE(f, arrival_random);
+    CHECKPOINT_SAVE(f, creation_order);
+
+    IRWL_READER_LOCK(student_lock)
+
+    /* Processes are written by the workload entry and thread they run */
+    CHECKPOINT_SAVE(f, process_count);
+    for (pid=0; pid<process_count; pid++)
+    {
+        CHECKPOINT_SAVE(f, process_table[pid].model);
+        CHECKPOINT_SAVE(f, process_table[pid].thread);
+        CHECKPOINT_SAVE(f, *pcb_of(pid));
+        CHECKPOINT_SAVE(f, cursor[pid]);
+        CHECKPOINT_SAVE(f, process_table[pid].last_cpu);
+        CHECKPOINT_SAVE(f, process_table[pid].home_node);
+        CHECKPOINT_SAVE(f, process_table[pid].arrival_time);
+        CHECKPOINT_SAVE(f, process_table[pid].live_threads);
+        CHECKPOINT_SAVE(f, process_table[pid].at_barrier);
+        CHECKPOINT_SAVE(f, process_table[pid].in_barrier);
+        CHECKPOINT_SAVE(f, process_table[pid].barrier_since);
+        CHECKPOINT_SAVE(f, process_table[pid].blocked_on);
+        CHECKPOINT_SAVE(f, process_table[pid].lock_next);
+        CHECKPOINT_SAVE(f, process_table[pid].lock_since);
+        CHECKPOINT_SAVE(f, process_table[pid].inverted);
+        CHECKPOINT_SAVE(f, process_table[pid].waiters);
+        CHECKPOINT_SAVE(f, process_table[pid].waiters_low);
+        CHECKPOINT_SAVE(f, process_table[pid].waiters_high);
+    }
+    CHECKPOINT_SAVE_ARRAY(f, turnaround, processes_terminated);
+
+    for (n=0; n<cpu_count; n++)
+    {
+        simulator_cpu_data_t *cpu = &simulator_cpu_data[n];
+
+        pid = cpu->current != NULL ? cpu->current->pid : PID_NONE;
+        CHECKPOINT_SAVE(f, pid);
+        CHECKPOINT_SAVE(f, cpu->preemption_timer);
+        CHECKPOINT_SAVE(f, cpu->work_start);
+        CHECKPOINT_SAVE(f, cpu->penalty_until);
+        CHECKPOINT_SAVE(f, cpu->rate);
+        CHECKPOINT_SAVE(f, cpu->remote);
+        CHECKPOINT_SAVE(f, cpu->busy_ticks);
+        CHECKPOINT_SAVE(f, cpu->frequency);
+        CHECKPOINT_SAVE(f, cpu->idle_since);
+        CHECKPOINT_SAVE(f, cpu->power_since);
+        CHECKPOINT_SAVE(f, cpu->residency);
+        CHECKPOINT_SAVE(f, cpu->energy);
+        CHECKPOINT_SAVE(f, cpu->timer.pending);
+        CHECKPOINT_SAVE(f, cpu->timer.expires);
+    }
+
+    for (r = io_queue_head; r != NULL; r = r->next)
+        io_count++;
+    CHECKPOINT_SAVE(f, io_count);
+    for (r = io_queue_head; r != NULL; r = r->next)
+    {
+        CHECKPOINT_SAVE(f, r->pcb->pid);
+        CHECKPOINT_SAVE(f, r->execution_time);
+    }
+    CHECKPOINT_SAVE(f, io_timer.pending);
+    CHECKPOINT_SAVE(f, io_timer.expires);
+
+    saved = save_scheduler(f);
+    IRWL_READER_UNLOCK(student_lock)
+
+    if (fclose(f) != 0 || saved != 0)
+    {
+        fprintf(stderr, "%s: checkpoint not written\n", checkpoint_path);
+        remove(checkpoint_path);
+    }
+}
+
+/*
+ * load_times() reads back an array of times written by save_checkpoint(),
+ * sized as record_time() would have grown it.  Nonzero on success.
+ */
+static int load_times(FILE *f, unsigned int **times, unsigned int *count)
+{
+    if (!CHECKPOINT_LOAD(f, *count))
+        return 0;
+    *times = realloc(*times, sizeof(unsigned int) *
+        (*count / TIMES_CHUNK + 1) * TIMES_CHUNK);
+    assert(*times != NULL);
+    return CHECKPOINT_LOAD_ARRAY(f, *times, *count);
+}
+
+/*
+ * restore_checkpoint() rebuilds the simulation from the checkpoint at
+ * restore_path, which must have been taken with the same number of CPUs
+ * and arrival model.  The scheduler's options may differ; see
+ * restore_scheduler().  Called before the CPU threads start.
+ */
+static void restore_checkpoint(void)
+{
+    FILE *f = fopen(restore_path, "rb");
+    unsigned int magic, version, count, kind, n, pid, model, thread;
+    unsigned int execution_time;
+    int saved_threaded;
+    wheel_timer_t saved_timer;
+    pcb_t *pcb;
+    int ok;
+
+    if (f == NULL)
+    {
+        perror(restore_path);
+        exit(-1);
+    }
+
+    ok = CHECKPOINT_LOAD(f, magic) && magic == CHECKPOINT_MAGIC &&
+        CHECKPOINT_LOAD(f, version) && version == CHECKPOINT_VERSION &&
+        CHECKPOINT_LOAD(f, count) && count == cpu_count &&
+        CHECKPOINT_LOAD(f, kind) && kind == (unsigned int)arrival_kind &&
+        CHECKPOINT_LOAD(f, saved_threaded) && saved_threaded == threaded;
+    if (!ok)
+    {
+        fprintf(stderr, "%s: not a checkpoint of this simulation (check "
+            "the CPU count, workload and arrival model)\n\n", restore_path);
+        exit(-1);
+    }
+
+    ok = CHECKPOINT_LOAD(f, simulator_time) &&
+        CHECKPOINT_LOAD(f, processes_terminated) &&
+        CHECKPOINT_LOAD(f, processes_created) &&
+        CHECKPOINT_LOAD(f, ready_counter) &&
+        CHECKPOINT_LOAD(f, running_counter) &&
+        CHECKPOINT_LOAD(f, waiting_counter) &&
+        CHECKPOINT_LOAD(f, context_switches) &&
+        CHECKPOINT_LOAD(f, switch_overhead) &&
+        CHECKPOINT_LOAD(f, migrations) &&
+        CHECKPOINT_LOAD(f, local_ticks) &&
+        CHECKPOINT_LOAD(f, remote_ticks) &&
+        CHECKPOINT_LOAD(f, remote_dispatches) &&
+        CHECKPOINT_LOAD(f, idle_exits) &&
+        CHECKPOINT_LOAD(f, exit_latency) &&
+        CHECKPOINT_LOAD(f, barrier_waits) &&
+        CHECKPOINT_LOAD(f, barrier_max) &&
+        CHECKPOINT_LOAD(f, barrier_ticks) &&
+        CHECKPOINT_LOAD(f, resources) &&
+        CHECKPOINT_LOAD(f, inversions) &&
+        CHECKPOINT_LOAD(f, inversion_max) &&
+        CHECKPOINT_LOAD(f, inversion_ticks) &&
+        load_times(f, &hold_times, &hold_count) &&
+        load_times(f, &wait_times, &wait_count) &&
+        CHECKPOINT_LOAD(f, arrival_random) &&
+        CHECKPOINT_LOAD(f, creation_order) &&
+        CHECKPOINT_LOAD(f, count);
+    wheel_init(&timers, simulator_time);
+
+    /* A thread but the first must follow the one before it */
+    for (n=0; ok && n<count; n++)
+    {
+        ok = CHECKPOINT_LOAD(f, model) && model < workload_count() &&
+            CHECKPOINT_LOAD(f, thread) && (thread == 0 ||
+            (threaded && n > 0 && thread < threaded_processes[model].threads &&
+            process_table[n - 1].model == model &&
+            process_table[n - 1].thread + 1 == thread));
+        if (!ok)
+            break;
+        pcb = spawn_thread(model, thread);
+        pid = pcb->pid;
+        ok = CHECKPOINT_LOAD(f, *pcb) && pcb->pid == pid &&
+            CHECKPOINT_LOAD(f, cursor[pid]) &&
+            CHECKPOINT_LOAD(f, process_table[pid].last_cpu) &&
+            CHECKPOINT_LOAD(f, process_table[pid].home_node) &&
+            CHECKPOINT_LOAD(f, process_table[pid].arrival_time) &&
+            CHECKPOINT_LOAD(f, process_table[pid].live_threads) &&
+            CHECKPOINT_LOAD(f, process_table[pid].at_barrier) &&
+            CHECKPOINT_LOAD(f, process_table[pid].in_barrier) &&
+            CHECKPOINT_LOAD(f, process_table[pid].barrier_since) &&
+            CHECKPOINT_LOAD(f, process_table[pid].blocked_on) &&
+            CHECKPOINT_LOAD(f, process_table[pid].lock_next) &&
+            CHECKPOINT_LOAD(f, process_table[pid].lock_since) &&
+            CHECKPOINT_LOAD(f, process_table[pid].inverted) &&
+            CHECKPOINT_LOAD(f, process_table[pid].waiters) &&
+            CHECKPOINT_LOAD(f, process_table[pid].waiters_low) &&
+            CHECKPOINT_LOAD(f, process_table[pid].waiters_high);
+    }
+    ok = ok && processes_terminated <= process_count &&
+        CHECKPOINT_LOAD_ARRAY(f, turnaround, processes_terminated);
+
+    /* A CPU running a process goes straight back to waiting on it */
+    for (n=0; ok && n<cpu_count; n++)
+    {
+        simulator_cpu_data_t *cpu = &simulator_cpu_data[n];
+
+        ok = CHECKPOINT_LOAD(f, pid) &&
+            (pid == PID_NONE || pid < process_count) &&
+            CHECKPOINT_LOAD(f, cpu->preemption_timer) &&
+            CHECKPOINT_LOAD(f, cpu->work_start) &&
+            CHECKPOINT_LOAD(f, cpu->penalty_until) &&
+            CHECKPOINT_LOAD(f, cpu->rate) && cpu->rate > 0 &&
+            CHECKPOINT_LOAD(f, cpu->remote) &&
+            CHECKPOINT_LOAD(f, cpu->busy_ticks) &&
+            CHECKPOINT_LOAD(f, cpu->frequency) &&
+            CHECKPOINT_LOAD(f, cpu->idle_since) &&
+            CHECKPOINT_LOAD(f, cpu->power_since) &&
+            CHECKPOINT_LOAD(f, cpu->residency) &&
+            CHECKPOINT_LOAD(f, cpu->energy) &&
+            CHECKPOINT_LOAD(f, saved_timer.pending) &&
+            (saved_timer.pending == 0 || pid != PID_NONE) &&
+            CHECKPOINT_LOAD(f, saved_timer.expires);
+        if (!ok)
+            break;
+        cpu->current = pid != PID_NONE ? pcb_of(pid) : NULL;
+        cpu->state = pid != PID_NONE ? CPU_RUNNING : CPU_IDLE;
+        if (saved_timer.pending)
+            wheel_add(&timers, &cpu->timer, saved_timer.expires);
+    }
+
+    /*
+     * submit_io_request() starts the device on a fresh request; the one at
+     * the head may be part way through, so its timer is set afterwards.
+     */
+    ok = ok && CHECKPOINT_LOAD(f, count);
+    for (n=0; ok && n<count; n++)
+    {
+        ok = CHECKPOINT_LOAD(f, pid) && pid < process_count &&
+            CHECKPOINT_LOAD(f, execution_time);
+        if (ok)
+            submit_io_request(pcb_of(pid), execution_time);
+    }
+    ok = ok && CHECKPOINT_LOAD(f, saved_timer.pending) &&
+        CHECKPOINT_LOAD(f, saved_timer.expires) &&
+        (saved_timer.pending != 0) == (io_queue_head != NULL);
+    if (ok && saved_timer.pending)
+        wheel_add(&timers, &io_timer, saved_timer.expires);
+
+    if (!ok || restore_scheduler(f) != 0)
+    {
+        fprintf(stderr, "%s: truncated or unusable checkpoint\n\n",
+            restore_path);
+        exit(-1);
+    }
+    fclose(f);
+}
+
+/*
+ * open_metrics() creates (or takes over) the shared memory segment named by
+ * -M, and sizes and maps it.
+ */
+static void open_metrics(void)
+{
+    int fd = shm_open(metrics_name, O_CREAT | O_RDWR, 0644);
+    void *segment = MAP_FAILED;
+
+    if (fd >= 0 && ftruncate(fd, sizeof(metrics_t)) == 0)
+        segment = mmap(NULL, sizeof(metrics_t), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED)
+    {
+        perror(metrics_name);
+        exit(-1);
+    }
+    if (fd >= 0)
+        close(fd);
+
+    metrics = segment;
+    publish_metrics(0, 0, 0, 0);
+}
+
+/*
+ * metrics_begin() and metrics_end() bracket a write to the segment.  The
+ * supervisor is the only writer.  seq is forced odd first, in case an
+ * earlier simulation died while writing.
+ */
+static void metrics_begin(void)
+{
+    uint32_t seq = __atomic_load_n(&metrics->seq, __ATOMIC_RELAXED) | 1u;
+
+    __atomic_store_n(&metrics->seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void metrics_end(void)
+{
+    uint32_t seq = __atomic_load_n(&metrics->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&metrics->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * publish_metrics() writes this tick's state to the segment.  Called by the
+ * supervisor with the simulator_mutex held.
+ */
+static void publish_metrics(unsigned int ready, unsigned int running,
+                            unsigned int waiting, unsigned int io_queue)
+{
+    unsigned int n;
+
+    if (metrics == NULL)
+        return;
+
+    metrics_begin();
+    METRICS_STORE(metrics->magic, METRICS_MAGIC);
+    METRICS_STORE(metrics->version, METRICS_VERSION);
+    METRICS_STORE(metrics->cpu_count, cpu_count);
+    METRICS_STORE(metrics->tick, simulator_time);
+    METRICS_STORE(metrics->ready, ready);
+    METRICS_STORE(metrics->running, running);
+    METRICS_STORE(metrics->waiting, waiting);
+    METRICS_STORE(metrics->io_queue, io_queue);
+    METRICS_STORE(metrics->context_switches, context_switches);
+    METRICS_STORE(metrics->migrations, migrations);
+    METRICS_STORE(metrics->processes_created, processes_created);
+    METRICS_STORE(metrics->processes_terminated, processes_terminated);
+    METRICS_STORE(metrics->done, 0);
+    for (n=0; n<METRICS_CPUS; n++)
+        METRICS_STORE(metrics->cpu_pid[n],
+            n < cpu_count && simulator_cpu_data[n].current != NULL ?
+            simulator_cpu_data[n].current->pid : METRICS_IDLE);
+    metrics_end();
+}
+
+/* finish_metrics() tells the monitors the simulation is over */
+static void finish_metrics(void)
+{
+    if (metrics == NULL)
+        return;
+
+    metrics_begin();
+    METRICS_STORE(metrics->tick, simulator_time);
+    METRICS_STORE(metrics->context_switches, context_switches);
+    METRICS_STORE(metrics->processes_terminated, processes_terminated);
+    METRICS_STORE(metrics->done, 1);
+    metrics_end();
+}
+
+extern void set_metrics(const char *name)
+{
+    metrics_name = name;
+}
+
+extern void set_checkpoint(unsigned int tick, const char *path)
+{
+    checkpoint_tick = tick;
+    checkpoint_path = path;
+}
+
+extern void set_restore(const char *path)
+{
+    restore_path = path;
+}
+
+extern void set_deterministic(int enable)
+{
+    deterministic = enable;
+}
+
+extern void set_workload_seed(unsigned int seed)
+{
+    workload_seed = seed;
+}
 
 
 /* Cheap hack -- passing an int through a void pointer */
@@ -623,6 +2676,17 @@ static void *simulator_cpu_thread_func(void *data)
 }
 
 
+extern unsigned int get_simulator_time(void)
+{
+    unsigned int now;
+
+    PROFILE_LOCK(&simulator_mutex, PROFILE_SIMULATOR_MUTEX);
+    now = simulator_time;
+    pthread_mutex_unlock(&simulator_mutex);
+    return now;
+}
+
+
 /* mt_safe_usleep() emulates the usleep() function, but is thread-safe */
 extern void mt_safe_usleep(long usec)
 {
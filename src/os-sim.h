@@ -24,44 +24,147 @@ typedef enum {
 } process_state_t;
 
 
+/*
+ * A program, the operations a process runs, ending in OP_TERMINATE.  The
+ * op_t arrays are read-only and may be shared by any number of processes
+ * and simulations.  A process's cursor is its current operation and the
+ * ticks of work left in it; a CPU not running at exactly one tick of work
+ * per tick also leaves partial, the fraction of the next tick of work done,
+ * in 1/1024ths.  OP_BARRIER, which takes no time, only appears in the
+ * programs of threads (see set_threaded_workload()).  So do OP_LOCK and
+ * OP_UNLOCK, which take and release the lock on resource number time, and
+ * are always followed by an OP_CPU.
+ */
+typedef enum {
+    OP_CPU = 0, OP_IO, OP_TERMINATE, OP_BARRIER, OP_LOCK, OP_UNLOCK
+} op_type;
+
+typedef struct {
+    op_type type;
+    unsigned int time;
+} op_t;
+
+typedef struct {
+    unsigned int op;
+    unsigned int remaining;
+    unsigned int partial;
+} op_cursor_t;
+
+
 /*
  * The Process Control Block
  *
- *   pid  : The Process ID, a unique number identifying the process. (read-only)
+ * A PCB holds only the state the scheduler reads and writes as processes
+ * move between queues, and fits one 64-byte cache line.  The simulator keeps
+ * PCBs in a dense table indexed by pid, and everything else about a process
+ * (its name, program and program counter) in tables of its own.
  *
- *   name : A string containing the name of the process. (read-only)
+ * The table is an array of PCBs rather than one array per field: a dispatch
+ * or a queue operation reads and writes several fields of one process, and
+ * with the process's fields together that is one cache miss, not one per
+ * field.  Only whole-table scans of a single field would favour separate
+ * arrays, and the scheduler does none.  The PCB must stay one line, so new
+ * per-process state that handlers do not touch on every event belongs in
+ * the simulator's tables instead.
  *
- *   time_remaining : An integer to be used by the shortest remaining
- *         time first algorithm.
+ *   pid  : The Process ID, a unique number identifying the process. (read-only)
  *
  *   state : The current state of the process.  This should be updated by the
  *        student's code in each of the handlers.  See the task_state_t
  *        struct above for possible values.
  *
- *   pc : The "program counter" of the process.  This value is actually used
- *        by the simulator to simulate the process.  Do not touch.
+ *   next : An unused link to another PCB, holding its pid (PID_NONE for
+ *        none).  You may use it to build a linked-list of PCBs; pcb_of()
+ *        turns a pid back into its PCB.
  *
- *   next : An unused pointer to another PCB.  You may use this pointer to
- *        build a linked-list of PCBs.
+ *   time_remaining : An integer to be used by the shortest remaining
+ *         time first algorithm.
+ *
+ *   priority : The priority of the process; a higher value is a higher
+ *        priority, 0 the lowest. (read-only)
+ *
+ *   deadline : The relative deadline of the process, in ticks (read-only).
+ *        Each time the process becomes ready (when it is created or its
+ *        I/O completes) it releases a job, its next CPU burst, which
+ *        should finish within deadline ticks.  0 for best-effort
+ *        processes.
+ *
+ *   enqueue_time : Scheduler bookkeeping, the time the process last entered
+ *        the ready queue.
+ *
+ *   abs_deadline : Scheduler bookkeeping, the absolute time by which the
+ *        current job should finish.
+ *
+ *   vruntime : Scheduler bookkeeping, the CPU time the process has used,
+ *        for fair sharing within its group.
+ *
+ *   dispatch_time, burst_run, slices, burst_estimate : Scheduler bookkeeping
+ *        for burst prediction.  burst_run is the CPU time used so far in
+ *        the current burst over slices dispatches, and burst_estimate an
+ *        exponentially weighted moving average of completed bursts.
+ *
+ *   last_cpu, warmth, skips : Scheduler bookkeeping for cache affinity.
+ *        last_cpu is the CPU the process last ran on, and warmth the
+ *        dispatch count of that CPU when it did (0 if it never ran), so the
+ *        fewer dispatches since, the warmer its cache.  skips counts how
+ *        often the process was passed over in favour of a warmer one.
  */
-typedef enum { OP_CPU = 0, OP_IO, OP_TERMINATE } op_type;
+#define PID_NONE 0xffffffffu
 
 typedef struct {
-    op_type type;
-    unsigned int time;
-} op_t;
-
-
-typedef struct _pcb_t {
     const unsigned int pid;
-    const char *name;
+    process_state_t state;
+    unsigned int next;
     unsigned int time_remaining;
     const unsigned int priority;
-    process_state_t state;
-    op_t *pc;
-    struct _pcb_t *next;
+    const unsigned int deadline;
+    unsigned int enqueue_time;
+    unsigned int abs_deadline;
+    unsigned int vruntime;
+    unsigned int dispatch_time;
+    unsigned int burst_run;
+    unsigned int slices;
+    float burst_estimate;
+    unsigned int last_cpu;
+    unsigned int warmth;
+    unsigned int skips;
 } pcb_t;
 
+__extension__ _Static_assert(sizeof(pcb_t) == 64,
+                             "pcb_t must fit one 64-byte cache line");
+
+
+/*
+ * The workload: the template every process is created from.
+ *
+ *   name : A string naming the process (and its program).
+ *
+ *   priority, deadline : Copied into the PCB of each process.
+ *
+ *   ops : The program.
+ */
+typedef struct {
+    const char *name;
+    unsigned int priority;
+    unsigned int deadline;
+    const op_t *ops;
+} program_t;
+
+
+/*
+ * The threaded workload: a process of threads threads, each running a
+ * program of its own, ops[0] to ops[threads - 1].  A thread reaching an
+ * OP_BARRIER waits until every thread of its process that has not
+ * terminated has reached one too.
+ */
+typedef struct {
+    const char *name;
+    unsigned int priority;
+    unsigned int deadline;
+    unsigned int threads;
+    const op_t *const *ops;
+} threaded_program_t;
+
 
 /*
  * start_simulator() runs the OS simulation.  The number of CPUs (1-16) should
@@ -70,6 +173,188 @@ typedef struct _pcb_t {
 extern void start_simulator(unsigned int cpu_count);
 
 
+/*
+ * set_workload_seed() selects the order in which the processes are created.
+ * Seed 0 keeps the order of the processes[] table; any other seed gives a
+ * deterministic shuffle of it.  Call it before start_simulator().
+ */
+extern void set_workload_seed(unsigned int seed);
+
+
+/*
+ * set_deterministic() makes runs repeatable: with it enabled, the same
+ * options always give the same schedule, however the host schedules the
+ * simulator's threads.  Idle CPUs then pick up newly ready processes one
+ * at a time, lowest numbered CPU first, at the tick they become ready.
+ * Call it before start_simulator().
+ */
+extern void set_deterministic(int enable);
+
+
+/*
+ * set_checkpoint() saves the whole state of the simulation to the file path
+ * at the start of tick tick, and carries on.  set_restore() starts the
+ * simulation from such a file instead of from tick 0, and then runs exactly
+ * as the checkpointed run did from that tick, unless the scheduling options
+ * differ: a checkpoint can start any number of what-if runs with another
+ * policy or time slice.  The restored run needs the same number of CPUs,
+ * workload and arrival options.  Both need deterministic mode.  Call them
+ * before start_simulator().
+ */
+extern void set_checkpoint(unsigned int tick, const char *path);
+extern void set_restore(const char *path);
+
+
+/*
+ * set_metrics() publishes the simulation's live counters, once per tick,
+ * in the POSIX shared memory segment called name, for external monitors.
+ * See metrics.h for its layout, and tools/metrics.c for a reader.  Call it
+ * before start_simulator().
+ */
+extern void set_metrics(const char *name);
+
+
+/*
+ * set_arrival_model() replaces the closed workload (each process in the
+ * processes[] table created once, one per second) with an open stream of
+ * arrivals.  Every arrival is a new process running one of the programs
+ * of processes[], picked with the workload seed.  spec is one of:
+ *
+ *   poisson:<rate>               : Poisson arrivals, <rate> per second
+ *   onoff:<rate>:<on>:<off>      : Poisson at <rate> for <on> ticks, then
+ *                                  nothing for <off> ticks, repeating
+ *   trace:<file>                 : one arrival per line of <file>, given as
+ *                                  "<tick> [<process name>]"
+ *
+ * The stream stops after max_arrivals processes (0 for no limit), and the
+ * simulation ends once they all terminate or at tick horizon (0 for no
+ * horizon), whichever is first.  An unbounded stream needs a horizon.
+ * Returns 0 on success, or -1 if the model cannot be used.  Call it before
+ * start_simulator().
+ */
+extern int set_arrival_model(const char *spec, unsigned int max_arrivals,
+                             unsigned int horizon);
+
+
+/*
+ * set_threaded_workload() creates the processes from threaded_processes[]
+ * instead of processes[].  Each thread of a process is scheduled on its own:
+ * it has a PCB of its own, and the threads of a process have consecutive
+ * pids.  A thread waiting at a barrier is PROCESS_WAITING, and is woken up
+ * with wake_up() once the barrier opens.  The final statistics then report
+ * how long threads waited at barriers.  Call it before start_simulator()
+ * and set_arrival_model().
+ *
+ * thread_group() returns the pid of the first thread of the process pcb
+ * is a thread of, which identifies that process, and thread_count() the
+ * number of threads it has.  A process of the ordinary workload is a
+ * group of one.
+ */
+extern void set_threaded_workload(int enable);
+extern unsigned int thread_group(const pcb_t *pcb);
+extern unsigned int thread_count(const pcb_t *pcb);
+
+
+/*
+ * Under the threaded workload processes take locks.  A process waiting for
+ * a lock is PROCESS_WAITING, and is woken up with wake_up() once the lock
+ * is handed to it; the final statistics report how long locks were held
+ * and waited for, and how long waiters spent behind a holder that was
+ * ready but not running (a priority inversion).
+ *
+ * lock_holder() returns the pid of the process holding the lock pcb waits
+ * for, or PID_NONE if it waits for none.  lock_waiters() returns the
+ * number of processes waiting on locks pcb holds, directly or behind a
+ * holder that waits on pcb in turn, and stores the lowest and highest of
+ * their priorities in *lowest and *highest.  Both may be called from any
+ * handler, and reflect the simulator's state as of the last event.
+ */
+extern unsigned int lock_holder(const pcb_t *pcb);
+extern unsigned int lock_waiters(const pcb_t *pcb, unsigned int *lowest,
+                                 unsigned int *highest);
+
+
+/*
+ * set_switch_costs() sets the simulated cost, in ticks, of changing what a
+ * CPU runs.  A CPU spends these ticks doing no useful work before the new
+ * process starts retiring its burst (and before its time slice starts).
+ *
+ *   switch_cost    : switching a CPU from one process to another
+ *   migration_cost : extra cost when a process resumes on a different CPU
+ *                    than it last ran on (its cache is cold)
+ *   idle_cost      : switching a CPU into or out of the idle process
+ *
+ * All costs default to 0.  Call it before start_simulator().
+ */
+extern void set_switch_costs(unsigned int switch_cost,
+                             unsigned int migration_cost,
+                             unsigned int idle_cost);
+
+
+/*
+ * set_topology() describes the host: sockets sockets of cores cores, each
+ * with threads hardware threads, which must make up the CPU count.  CPUs
+ * are numbered thread first, then core, then socket, and each socket is a
+ * NUMA node.  A process's memory is on the node it first runs on; running
+ * on any other node it does remote_penalty percent less work per tick.
+ * Without a topology all CPUs form one node.  Call it before
+ * start_simulator().
+ */
+extern void set_topology(unsigned int sockets, unsigned int cores,
+                         unsigned int threads, unsigned int remote_penalty);
+
+
+/*
+ * node_count() returns the number of NUMA nodes, cpu_node() the node of
+ * CPU cpu_id, and process_node() the node a process's memory is on, or -1
+ * if it has not run yet.
+ */
+extern unsigned int node_count(void);
+extern unsigned int cpu_node(unsigned int cpu_id);
+extern int process_node(const pcb_t *pcb);
+
+
+/*
+ * set_cpu_capacity() makes CPU cpu_id retire percent percent of a nominal
+ * CPU's work per tick (default 100), so a big core finishes a burst sooner
+ * than a little one.  cpu_capacity() returns it.  Call set_cpu_capacity()
+ * before start_simulator().
+ */
+extern void set_cpu_capacity(unsigned int cpu_id, unsigned int percent);
+extern unsigned int cpu_capacity(unsigned int cpu_id);
+
+
+/*
+ * set_power_states() turns on the energy model.  A CPU with a process is
+ * active, drawing power that grows with the cube of its frequency; an idle
+ * CPU is in shallow idle for its first deep_after ticks, then in deep
+ * idle, which draws far less.  Handing an idle CPU a process costs it the
+ * exit latency of the state it reached, shallow_exit or deep_exit ticks,
+ * during which it does no work.  The final statistics then report energy,
+ * energy-delay product and the time spent in each state.  Call it before
+ * start_simulator().
+ *
+ * set_cpu_frequency() runs CPU cpu_id at percent (1-100) of its nominal
+ * frequency from its next dispatch on, getting that much less work done
+ * per tick.  It may be called at any time.
+ */
+extern void set_power_states(unsigned int deep_after,
+                             unsigned int shallow_exit,
+                             unsigned int deep_exit);
+extern void set_cpu_frequency(unsigned int cpu_id, unsigned int percent);
+
+
+/*
+ * set_cpu_parked() parks or unparks CPU cpu_id, and cpu_parked() tells
+ * whether it is parked.  A parked CPU is kept idle, so it can reach deep
+ * idle: the scheduler must not dispatch to it, and deterministic mode
+ * never lets it pick up newly ready processes.  Only an idle CPU may be
+ * parked.  It may be called at any time.
+ */
+extern void set_cpu_parked(unsigned int cpu_id, int park);
+extern int cpu_parked(unsigned int cpu_id);
+
+
 /*
  * context_switch() schedules a process on a CPU.  Note that it is
  * non-blocking.  It does not actually simulate the execution of the process;
@@ -85,6 +370,17 @@ extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
                            int preemption_time);
 
 
+/*
+ * context_switch_batch() schedules count processes at once: pcbs[n] on CPU
+ * cpu_ids[n] with time slice time_slices[n], each as context_switch()
+ * would, but taking the simulator's lock once for the lot.  It lets one
+ * handler dispatch several idle CPUs together; the CPUs must be distinct.
+ */
+extern void context_switch_batch(unsigned int count,
+                                 const unsigned int *cpu_ids,
+                                 pcb_t *const *pcbs, const int *time_slices);
+
+
 /*
  * force_preempt() preempts a running process before its timeslice expires.
  * It should be used by the SRTF scheduler to preempt lower
@@ -93,6 +389,28 @@ extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
 extern void force_preempt(unsigned int cpu_id);
 
 
+/*
+ * pcb_of() returns the PCB of process pid.  A PCB never moves, so the
+ * pointer stays valid for the rest of the simulation.  pid_count() returns
+ * the number of processes created so far: the pids below it are the ones
+ * pcb_of() accepts.
+ */
+extern pcb_t *pcb_of(unsigned int pid);
+extern unsigned int pid_count(void);
+
+
+/*
+ * process_name() returns the name of a process.
+ */
+extern const char *process_name(const pcb_t *pcb);
+
+
+/*
+ * get_simulator_time() returns the current simulated time in ticks.
+ */
+extern unsigned int get_simulator_time(void);
+
+
 /*
  * mt_safe_usleep() is a thread-safe implementation of the usleep() function.
  * See man usleep(3) for the behavior of this function.
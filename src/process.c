@@ -13,10 +13,14 @@
 /*
  * Note: The operations must alternate: OP_CPU, OP_IO, OP_CPU, ...
  * In addition, the first and last operations must be OP_CPU.  Otherwise,
- * the simulator will not work.
+ * the simulator will not work.  The only exception is OP_BARRIER, which may
+ * stand between two OP_CPU in the programs of threads.
+ *
+ * The operation arrays are never written; each process keeps its position
+ * in them in a program counter of its own, in the simulator.
  */
 
-static op_t pid0_ops[] = {
+static const op_t pid0_ops[] = {
     { OP_CPU, 2 },
     { OP_IO, 2 },
     { OP_CPU, 3 },
@@ -49,7 +53,7 @@ static op_t pid0_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-static op_t pid1_ops[] = {
+static const op_t pid1_ops[] = {
     { OP_CPU, 3 },
     { OP_IO, 4 },
     { OP_CPU, 2 },
@@ -80,7 +84,7 @@ static op_t pid1_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-static op_t pid2_ops[] = {
+static const op_t pid2_ops[] = {
     { OP_CPU, 1 },
     { OP_IO, 4 },
     { OP_CPU, 2 },
@@ -109,7 +113,7 @@ static op_t pid2_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-static op_t pid3_ops[] = {
+static const op_t pid3_ops[] = {
     { OP_CPU, 9 },
     { OP_IO, 1 },
     { OP_CPU, 6 },
@@ -132,7 +136,7 @@ static op_t pid3_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-static op_t pid4_ops[] = {
+static const op_t pid4_ops[] = {
     { OP_CPU, 10 }, 
     { OP_IO, 1 },
     { OP_CPU, 14 },
@@ -155,7 +159,7 @@ static op_t pid4_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-static op_t pid5_ops[] = {
+static const op_t pid5_ops[] = {
     { OP_CPU, 9 }, 
     { OP_IO, 1 },
     { OP_CPU, 10 },
@@ -178,7 +182,7 @@ static op_t pid5_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-static op_t pid6_ops[] = {
+static const op_t pid6_ops[] = {
     { OP_CPU, 6 }, 
     { OP_IO, 3 },
     { OP_CPU, 9 },
@@ -201,7 +205,7 @@ static op_t pid6_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-static op_t pid7_ops[] = {
+static const op_t pid7_ops[] = {
     { OP_CPU, 6 }, 
     { OP_IO, 3 },
     { OP_CPU, 12 },
@@ -224,15 +228,197 @@ static op_t pid7_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-pcb_t processes[PROCESS_COUNT] = {
-    { 0, "Iapache", 2, 1, PROCESS_NEW, pid0_ops, NULL },
-    { 1, "Ibash", 3, 2, PROCESS_NEW, pid1_ops, NULL },
-    { 2, "Imozilla", 1, 0, PROCESS_NEW, pid2_ops, NULL },
-    { 3, "Ccpu", 9, 3, PROCESS_NEW, pid3_ops, NULL },
-    { 4, "Cgcc", 10, 4, PROCESS_NEW, pid4_ops, NULL },
-    { 5, "Cspice", 9, 7, PROCESS_NEW, pid5_ops, NULL },
-    { 6, "Cmysql", 6, 6, PROCESS_NEW, pid6_ops, NULL },
-    { 7, "Csim", 6, 5, PROCESS_NEW, pid7_ops, NULL }
+/*
+ * The interactive Iapache and Ibash have latency targets: each of their CPU
+ * bursts should finish within 0.6 s and 0.8 s of the process becoming
+ * ready.  The rest are best-effort (deadline 0).
+ */
+const program_t processes[PROCESS_COUNT] = {
+    { "Iapache", 1, 6, pid0_ops },
+    { "Ibash", 2, 8, pid1_ops },
+    { "Imozilla", 0, 0, pid2_ops },
+    { "Ccpu", 3, 0, pid3_ops },
+    { "Cgcc", 4, 0, pid4_ops },
+    { "Cspice", 7, 0, pid5_ops },
+    { "Cmysql", 6, 0, pid6_ops },
+    { "Csim", 5, 0, pid7_ops }
+};
+
+
+
+
+/*
+ * The threaded workload.  Tsolver is a bulk-synchronous solver: its four
+ * threads compute, then meet at a barrier, three times over, and each
+ * thread has more work in some phases than the others.  Tweb's threads
+ * serve requests on their own and meet once at the end; Tbuild's two
+ * threads meet before linking.  Iedit is an ordinary, single-threaded
+ * interactive process.
+ *
+ * Tweb's threads hold the "db" lock over long stretches of each request,
+ * which Iedit takes briefly, and Tbuild's threads share the "log" lock, so
+ * under priorities a low-priority Tweb thread can keep the high-priority
+ * Iedit waiting while Tsolver and Tbuild run.
+ *
+ * The threads of one process must pass the same number of barriers, and
+ * must release every lock they take.
+ */
+static const op_t solver0_ops[] = {
+    { OP_CPU, 4 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 6 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 3 },
+    { OP_IO, 2 },
+    { OP_CPU, 5 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 4 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t solver1_ops[] = {
+    { OP_CPU, 5 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 4 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 5 },
+    { OP_IO, 3 },
+    { OP_CPU, 4 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 6 },
+    { OP_TERMINATE, 0 }
 };
 
+static const op_t solver2_ops[] = {
+    { OP_CPU, 3 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 7 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 4 },
+    { OP_IO, 2 },
+    { OP_CPU, 6 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 3 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t solver3_ops[] = {
+    { OP_CPU, 6 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 5 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 4 },
+    { OP_IO, 4 },
+    { OP_CPU, 5 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 5 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t web0_ops[] = {
+    { OP_CPU, 1 },
+    { OP_LOCK, 0 },
+    { OP_CPU, 2 },
+    { OP_UNLOCK, 0 },
+    { OP_CPU, 1 },
+    { OP_IO, 3 },
+    { OP_CPU, 2 },
+    { OP_IO, 3 },
+    { OP_CPU, 2 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 1 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t web1_ops[] = {
+    { OP_CPU, 1 },
+    { OP_IO, 2 },
+    { OP_CPU, 1 },
+    { OP_LOCK, 0 },
+    { OP_CPU, 3 },
+    { OP_UNLOCK, 0 },
+    { OP_CPU, 1 },
+    { OP_IO, 4 },
+    { OP_CPU, 3 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 1 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t web2_ops[] = {
+    { OP_CPU, 1 },
+    { OP_IO, 5 },
+    { OP_CPU, 1 },
+    { OP_LOCK, 0 },
+    { OP_CPU, 2 },
+    { OP_UNLOCK, 0 },
+    { OP_CPU, 1 },
+    { OP_IO, 2 },
+    { OP_CPU, 2 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 1 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t build0_ops[] = {
+    { OP_CPU, 8 },
+    { OP_IO, 2 },
+    { OP_CPU, 3 },
+    { OP_LOCK, 1 },
+    { OP_CPU, 2 },
+    { OP_UNLOCK, 1 },
+    { OP_CPU, 1 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 3 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t build1_ops[] = {
+    { OP_CPU, 5 },
+    { OP_IO, 4 },
+    { OP_CPU, 6 },
+    { OP_LOCK, 1 },
+    { OP_CPU, 2 },
+    { OP_UNLOCK, 1 },
+    { OP_CPU, 1 },
+    { OP_BARRIER, 0 },
+    { OP_CPU, 3 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t edit_ops[] = {
+    { OP_CPU, 1 },
+    { OP_IO, 4 },
+    { OP_CPU, 1 },
+    { OP_LOCK, 0 },
+    { OP_CPU, 1 },
+    { OP_UNLOCK, 0 },
+    { OP_CPU, 1 },
+    { OP_IO, 3 },
+    { OP_CPU, 1 },
+    { OP_IO, 4 },
+    { OP_CPU, 1 },
+    { OP_LOCK, 0 },
+    { OP_CPU, 1 },
+    { OP_UNLOCK, 0 },
+    { OP_CPU, 1 },
+    { OP_IO, 3 },
+    { OP_CPU, 2 },
+    { OP_TERMINATE, 0 }
+};
+
+static const op_t *const solver_threads[] = {
+    solver0_ops, solver1_ops, solver2_ops, solver3_ops
+};
+static const op_t *const web_threads[] = { web0_ops, web1_ops, web2_ops };
+static const op_t *const build_threads[] = { build0_ops, build1_ops };
+static const op_t *const edit_threads[] = { edit_ops };
+
+const threaded_program_t threaded_processes[THREADED_COUNT] = {
+    { "Tsolver", 3, 0, 4, solver_threads },
+    { "Tweb", 1, 0, 3, web_threads },
+    { "Tbuild", 4, 0, 2, build_threads },
+    { "Iedit", 5, 8, 1, edit_threads }
+};
 
+const char *const resource_names[RESOURCE_COUNT] = { "db", "log" };
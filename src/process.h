@@ -10,4 +10,11 @@
 
 
 #define PROCESS_COUNT 8
-extern pcb_t processes[PROCESS_COUNT];
+extern const program_t processes[PROCESS_COUNT];
+
+#define THREADED_COUNT 4
+extern const threaded_program_t threaded_processes[THREADED_COUNT];
+
+/* The resources OP_LOCK and OP_UNLOCK name by their index in this array */
+#define RESOURCE_COUNT 2
+extern const char *const resource_names[RESOURCE_COUNT];
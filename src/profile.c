@@ -0,0 +1,222 @@
+/*
+ * profile.c
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * Hot-path instrumentation.  See profile.h.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "profile.h"
+
+
+/* Bucket n counts samples of [2^n, 2^(n+1)) ns; bucket 0 also counts 0 ns */
+#define PROFILE_BUCKETS 40
+
+typedef struct {
+    unsigned long count;
+    unsigned long long total;
+    unsigned long long max;
+    unsigned long buckets[PROFILE_BUCKETS];
+} profile_histogram_t;
+
+typedef struct _profile_thread_t {
+    profile_histogram_t events[PROFILE_EVENTS];
+    profile_histogram_t lock_wait[PROFILE_LOCKS];
+    unsigned long acquisitions[PROFILE_LOCKS];
+    struct _profile_thread_t *next;
+} profile_thread_t;
+
+static const char *event_names[PROFILE_EVENTS] = {
+    "idle()", "preempt()", "yield()", "terminate()", "wake_up()",
+    "force_preempt()->preempt()"
+};
+static const char *lock_names[PROFILE_LOCKS] = {
+    "simulator_mutex", "student_lock", "rq_mutex", "current_mutex"
+};
+
+static __thread profile_thread_t *self = NULL;
+static profile_thread_t *threads = NULL;
+static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static profile_thread_t *profile_self(void);
+static void add_sample(profile_histogram_t *histogram,
+                       unsigned long long ns);
+static void merge(profile_histogram_t *into, const profile_histogram_t *from);
+static unsigned long long percentile(const profile_histogram_t *histogram,
+                                     double p);
+static void print_histogram(const char *name,
+                            const profile_histogram_t *histogram);
+
+
+/* A thread's histograms are allocated, and listed, on its first sample */
+static profile_thread_t *profile_self(void)
+{
+    if (self == NULL)
+    {
+        self = calloc(1, sizeof(profile_thread_t));
+        assert(self != NULL);
+        pthread_mutex_lock(&threads_mutex);
+        self->next = threads;
+        threads = self;
+        pthread_mutex_unlock(&threads_mutex);
+    }
+    return self;
+}
+
+static void add_sample(profile_histogram_t *histogram, unsigned long long ns)
+{
+    unsigned int bucket = 0;
+
+    if (ns > 1)
+        bucket = 63u - (unsigned int)__builtin_clzll(ns);
+    if (bucket >= PROFILE_BUCKETS)
+        bucket = PROFILE_BUCKETS - 1;
+
+    histogram->count++;
+    histogram->total += ns;
+    if (ns > histogram->max)
+        histogram->max = ns;
+    histogram->buckets[bucket]++;
+}
+
+static void merge(profile_histogram_t *into, const profile_histogram_t *from)
+{
+    unsigned int n;
+
+    into->count += from->count;
+    into->total += from->total;
+    if (from->max > into->max)
+        into->max = from->max;
+    for (n=0; n<PROFILE_BUCKETS; n++)
+        into->buckets[n] += from->buckets[n];
+}
+
+/* The upper bound of the bucket holding the p-th percentile */
+static unsigned long long percentile(const profile_histogram_t *histogram,
+                                     double p)
+{
+    unsigned long seen = 0;
+    unsigned int n;
+
+    for (n=0; n<PROFILE_BUCKETS; n++)
+    {
+        seen += histogram->buckets[n];
+        if ((double)seen >= p * (double)histogram->count)
+            break;
+    }
+    if (n >= PROFILE_BUCKETS - 1)
+        return histogram->max;
+    return 1ull << (n + 1);
+}
+
+static void print_histogram(const char *name,
+                            const profile_histogram_t *histogram)
+{
+    unsigned int n;
+
+    if (histogram->count == 0)
+    {
+        printf("  %-28s no samples\n", name);
+        return;
+    }
+
+    printf("  %-28s n %lu, mean %.1f us, p50 < %.1f us, p99 < %.1f us, "
+        "max %.1f us\n", name, histogram->count,
+        (double)histogram->total / (double)histogram->count / 1000.0,
+        (double)percentile(histogram, 0.50) / 1000.0,
+        (double)percentile(histogram, 0.99) / 1000.0,
+        (double)histogram->max / 1000.0);
+
+    /* The non-empty buckets, by their lower bound */
+    printf("  %-28s", "");
+    for (n=0; n<PROFILE_BUCKETS; n++)
+    {
+        if (histogram->buckets[n] == 0)
+            continue;
+        if (n < 10)
+            printf(" %lluns:%lu", 1ull << n, histogram->buckets[n]);
+        else if (n < 20)
+            printf(" %lluus:%lu", (1ull << n) / 1000, histogram->buckets[n]);
+        else
+            printf(" %llums:%lu", (1ull << n) / 1000000,
+                histogram->buckets[n]);
+    }
+    printf("\n");
+}
+
+extern unsigned long long profile_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull +
+        (unsigned long long)now.tv_nsec;
+}
+
+extern void profile_record(profile_event_t event, unsigned long long start)
+{
+    if (start == 0)
+        return;
+    add_sample(&profile_self()->events[event], profile_now() - start);
+}
+
+extern void profile_lock(pthread_mutex_t *mutex, profile_lock_t lock)
+{
+    profile_thread_t *thread = profile_self();
+    unsigned long long start;
+
+    thread->acquisitions[lock]++;
+    if (pthread_mutex_trylock(mutex) == 0)
+        return;
+
+    start = profile_now();
+    pthread_mutex_lock(mutex);
+    add_sample(&thread->lock_wait[lock], profile_now() - start);
+}
+
+/*
+ * profile_report() is called at exit, when the other threads are parked,
+ * so their histograms can be read without locking them.
+ */
+extern void profile_report(void)
+{
+    profile_histogram_t events[PROFILE_EVENTS] = { { 0, 0, 0, { 0 } } };
+    profile_histogram_t lock_wait[PROFILE_LOCKS] = { { 0, 0, 0, { 0 } } };
+    unsigned long acquisitions[PROFILE_LOCKS] = { 0 };
+    const profile_thread_t *thread;
+    unsigned int n, thread_count = 0;
+
+    pthread_mutex_lock(&threads_mutex);
+    for (thread = threads; thread != NULL; thread = thread->next)
+    {
+        thread_count++;
+        for (n=0; n<PROFILE_EVENTS; n++)
+            merge(&events[n], &thread->events[n]);
+        for (n=0; n<PROFILE_LOCKS; n++)
+        {
+            merge(&lock_wait[n], &thread->lock_wait[n]);
+            acquisitions[n] += thread->acquisitions[n];
+        }
+    }
+    pthread_mutex_unlock(&threads_mutex);
+
+    printf("\nProfile (%u threads):\n", thread_count);
+    printf(" Handler latency:\n");
+    for (n=0; n<PROFILE_EVENTS; n++)
+        print_histogram(event_names[n], &events[n]);
+
+    printf(" Lock waits:\n");
+    for (n=0; n<PROFILE_LOCKS; n++)
+    {
+        printf("  %-28s %lu acquisitions, %lu contended (%.1f%%)\n",
+            lock_names[n], acquisitions[n], lock_wait[n].count,
+            acquisitions[n] ? 100.0 * (double)lock_wait[n].count /
+            (double)acquisitions[n] : 0.0);
+        if (lock_wait[n].count > 0)
+            print_histogram("", &lock_wait[n]);
+    }
+}
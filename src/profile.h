@@ -0,0 +1,64 @@
+/*
+ * profile.h
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * Optional instrumentation of the simulator's hot paths: how long each
+ * student handler takes, how long a force_preempt() takes to reach the
+ * preempt() handler, and how long threads wait for the simulator's locks.
+ *
+ * It is compiled in only with -DPROFILE (make profile).  Otherwise the
+ * macros below expand to nothing, or to the plain pthread call.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+
+typedef enum {
+    PROFILE_IDLE = 0,
+    PROFILE_PREEMPT,
+    PROFILE_YIELD,
+    PROFILE_TERMINATE,
+    PROFILE_WAKE_UP,
+    PROFILE_FORCE_PREEMPT,      /* force_preempt() until preempt() starts */
+    PROFILE_EVENTS
+} profile_event_t;
+
+typedef enum {
+    PROFILE_SIMULATOR_MUTEX = 0,
+    PROFILE_STUDENT_LOCK,
+    PROFILE_RQ_MUTEX,
+    PROFILE_CURRENT_MUTEX,
+    PROFILE_LOCKS
+} profile_lock_t;
+
+
+/*
+ * Samples go to histograms private to the thread that takes them, so
+ * profiling adds no locking of its own; profile_report() merges them.
+ *
+ *   profile_now()     : monotonic host time in nanoseconds
+ *   profile_record()  : adds the time since start to event's histogram
+ *   profile_lock()    : locks mutex, counting the acquisition and, if the
+ *                       mutex was taken, the time spent waiting for it
+ *   profile_report()  : prints the merged histograms
+ */
+extern unsigned long long profile_now(void);
+extern void profile_record(profile_event_t event, unsigned long long start);
+extern void profile_lock(pthread_mutex_t *mutex, profile_lock_t lock);
+extern void profile_report(void);
+
+#ifdef PROFILE
+#define PROFILE_DECLARE(t) unsigned long long t = 0
+#define PROFILE_STAMP(t) (t) = profile_now()
+#define PROFILE_RECORD(event, t) profile_record(event, t)
+#define PROFILE_LOCK(mutex, lock) profile_lock(mutex, lock)
+#define PROFILE_REPORT() profile_report()
+#else
+#define PROFILE_DECLARE(t)
+#define PROFILE_STAMP(t)
+#define PROFILE_RECORD(event, t)
+#define PROFILE_LOCK(mutex, lock) pthread_mutex_lock(mutex)
+#define PROFILE_REPORT()
+#endif
@@ -0,0 +1,79 @@
+/*
+ * sched-ops.h
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * The interface between the scheduler's handlers and a scheduling policy.
+ * The handlers in student.c do what every policy needs (process states,
+ * burst bookkeeping, the earliest-deadline-first class and idle CPUs), and
+ * ask the policy in force, through its table of operations, where a ready
+ * process goes and which one runs next.
+ *
+ * The built-in policies are tables in student.c.  A policy can also be
+ * built as a shared object and chosen at run time with -P <file>[:<args>];
+ * the object exports its table as
+ *
+ *     const sched_ops_t sched_ops = { SCHED_OPS_VERSION, "name", ... };
+ *
+ * and may call the simulator API of os-sim.h and the functions below.
+ */
+
+#pragma once
+
+#include "os-sim.h"
+
+
+#define SCHED_OPS_VERSION 1
+
+/*
+ * The operations.  Only enqueue, pick_next and empty are required; the
+ * others may be NULL.
+ *
+ *   init          : sets the policy up for cpu_count CPUs before the
+ *                   simulation starts.  args is the text after the ':' of
+ *                   -P, or NULL.  Returns 0, or -1 to refuse to run.
+ *   enqueue       : adds a ready process to the policy's queue
+ *   pick_next     : removes and returns the process cpu_id should run
+ *                   next, or NULL to idle
+ *   empty         : nonzero if the queue holds no process
+ *   on_preempt    : process was preempted after running ran ticks
+ *   on_yield      : process left the CPU of its own accord after running ran
+ *                   ticks, for I/O or because it terminated (its state
+ *                   tells which)
+ *   on_wake       : process has just been queued on becoming ready; returns
+ *                   the CPU to preempt in its favour, or -1
+ *   timeslice_for : the time slice to dispatch process with, in ticks, or
+ *                   -1 for none.  By default the slice given by -r or -R.
+ *   print_stats   : prints the policy's own statistics at the end
+ *
+ * Locking: enqueue, pick_next, empty, on_preempt and on_yield are called
+ * with the ready queue lock held, so never at the same time as each other.
+ * on_wake is called with the lock on the running processes held, so it may
+ * look at them with sched_running().
+ */
+typedef struct {
+    unsigned int version;
+    const char *name;
+
+    int (*init)(unsigned int cpu_count, const char *args);
+    void (*enqueue)(pcb_t *process);
+    pcb_t *(*pick_next)(unsigned int cpu_id);
+    int (*empty)(void);
+    void (*on_preempt)(pcb_t *process, unsigned int ran);
+    void (*on_yield)(pcb_t *process, unsigned int ran);
+    int (*on_wake)(const pcb_t *process);
+    int (*timeslice_for)(const pcb_t *process);
+    void (*print_stats)(void);
+} sched_ops_t;
+
+
+/*
+ * sched_cpu_count() returns the number of CPUs.
+ */
+extern unsigned int sched_cpu_count(void);
+
+
+/*
+ * sched_running() returns the process running on cpu_id, or NULL if it is
+ * idle.  Only valid inside on_wake().
+ */
+extern const pcb_t *sched_running(unsigned int cpu_id);
@@ -7,12 +7,20 @@
  */
 
 #include <assert.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "checkpoint.h"
 #include "os-sim.h"
+#include "heap.h"
+#include "profile.h"
+#include "sched-ops.h"
 #include <string.h>
+#include <time.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -23,6 +31,9 @@ extern void preempt(unsigned int cpu_id);
 extern void yield(unsigned int cpu_id);
 extern void terminate(unsigned int cpu_id);
 extern void wake_up(pcb_t *process);
+extern void print_scheduler_stats(void);
+extern int save_scheduler(FILE *f);
+extern int restore_scheduler(FILE *f);
 
 
 void help(void);
@@ -43,100 +54,1474 @@ static pthread_mutex_t current_mutex;
 
 static int TimeSlice;
 static pthread_cond_t no_idle;
-static pcb_t* head;
-static int strf_true;
+
+/*
+ * The FIFO / round-robin ready queue is linked through the PCBs' next
+ * fields by pid, from head to tail; PID_NONE when empty.
+ */
+static unsigned int head, tail;
 static unsigned int cpu_count;
 static pthread_mutex_t rq_mutex;
-static int round_robin;
-static int prior;
+static int affinity;
+static unsigned int *cpu_dispatches;
+
+/*
+ * The scheduling policy in force (see sched-ops.h).  Its table is copied
+ * here with the operations it leaves out filled in, so the handlers make
+ * one indirect call per decision and never test for a missing one.
+ */
+static sched_ops_t sched;
+static const sched_ops_t *sched_table;
+
+/*
+ * With cache affinity on, schedule() looks at most AFFINITY_WINDOW
+ * processes into the ready queue for one that last ran on the asking CPU
+ * no more than AFFINITY_WARM dispatches ago.  The head of the queue is
+ * never passed over more than AFFINITY_MAX_SKIPS times in a row.
+ */
+#define AFFINITY_WINDOW 4
+#define AFFINITY_WARM 4
+#define AFFINITY_MAX_SKIPS 3
+
+/*
+ * Adaptive round-robin (-R) sizes every slice from the process's burst
+ * estimate, an EWMA with weight burst_alpha on the newest burst.  The slice
+ * covers the estimate plus a quarter, clamped to [slice_min, slice_max], so
+ * a typical I/O-bound burst finishes in one slice and a CPU hog is still
+ * preempted at slice_max.
+ */
+static float burst_alpha;
+static int adaptive;
+static unsigned int slice_min, slice_max;
+static unsigned int bursts_total, bursts_one_slice;
+
+/*
+ * Shortest-remaining-time-first keeps its ready queue in rq_heap, ordered
+ * by remaining burst: the true time_remaining for the oracle scheduler
+ * (-s), or the burst estimate less what has already run for the
+ * predictive one (-e <alpha>), which only learns from past bursts.
+ */
+static int predictive;
+static heap_t rq_heap;
+static double prediction_error;
+static unsigned int predictions;
+
+/*
+ * The priority scheduler (-p) shares rq_heap.  A waiting process gains one
+ * level of effective priority every aging_ticks ticks, so its key is
+ * enqueue_time - priority * aging_ticks: smaller keys run first, and the
+ * order of two waiting processes never changes while they wait.
+ *
+ * To find a CPU to preempt without a scan, level_cpus[l] is the bitmap of
+ * CPUs running a process of priority l, busy_levels the bitmap of levels
+ * with any such CPU, and idle_cpus the bitmap of idle CPUs.  All three are
+ * protected by current_mutex.
+ *
+ * With priority inheritance (-I) a process holding a lock runs at the
+ * priority of the highest waiter behind it, if that is above its own.
+ * The bitmaps keep the priority a process was dispatched with, so a
+ * waking process then scans the CPUs instead.  A process that blocks on a
+ * lock re-queues its holder, and the holder's holders, at the priority it
+ * lends them; priority_boosts counts those.
+ */
+#define PRIORITY_LEVELS 32
+#define PRIORITY_AGING 10
+
+static unsigned int aging_ticks;
+static unsigned int level_cpus[PRIORITY_LEVELS];
+static unsigned int busy_levels;
+static unsigned int idle_cpus;
+static unsigned int max_wait[PRIORITY_LEVELS];
+static int inherit;
+static unsigned int priority_boosts;
+
+/*
+ * The earliest-deadline-first class (-d) holds every ready process with a
+ * deadline in edf_heap, keyed by absolute deadline.  schedule() always
+ * drains it before asking the best-effort policy, and a waking job
+ * preempts best-effort work or a job with a later deadline.  Lateness of
+ * finished jobs is tracked under every policy, so they can be compared,
+ * and counted in power-of-two buckets: bucket 0 is on time,
+ * bucket b >= 1 is late by [2^(b-1), 2^b) ticks.
+ */
+#define LATENESS_BUCKETS 8
+
+static int edf;
+static heap_t edf_heap;
+static unsigned int jobs_done, jobs_missed, max_lateness;
+static unsigned long total_lateness;
+static unsigned int lateness_hist[LATENESS_BUCKETS];
+
+/*
+ * Hierarchical fair share (-f) puts each process in the group named by the
+ * first letter of its name (I for interactive, C for compute, ...) and
+ * splits the CPUs between groups in proportion to their weights, however
+ * many processes each holds.  A group's vruntime is its CPU time divided
+ * by its weight; group_heap orders the groups with ready processes by it,
+ * and each group's procs heap orders its processes by their own CPU time.
+ *
+ * A group or process that was not runnable is brought up to the smallest
+ * vruntime in use when it becomes runnable again, so sleeping does not bank
+ * credit.  Group keys in group_heap may be stale (too small) because
+ * vruntimes only grow while the group waits; fair_pop() re-inserts such
+ * entries with their current key before trusting them.
+ */
+typedef struct {
+    char prefix;
+    unsigned int weight;
+    double vruntime;
+    unsigned int min_vruntime;
+    unsigned long cpu_time;
+    int queued;
+    heap_t procs;
+} group_t;
+
+static group_t *groups[UCHAR_MAX + 1];
+static heap_t group_heap;
+static double min_group_vruntime;
+
+/*
+ * With a NUMA topology (-N), FIFO and round-robin keep one queue per node,
+ * linked through the PCBs like the global one.  A process queues on the
+ * node its memory is on, or before it has run on the node with the fewest
+ * queued.  A CPU serves its own node's queue, which its SMT siblings and
+ * the other cores of its socket share, and only when that is empty steals
+ * from the node with the longest queue, to run the process remotely.
+ */
+typedef struct {
+    unsigned int head, tail, length;
+} pid_queue_t;
+
+static unsigned int nodes;
+static pid_queue_t *node_queues;
+static unsigned int node_local, node_steals;
+
+/*
+ * Capacity-aware scheduling (-k <ticks>[:<imbalance>]) for CPUs of unequal
+ * capacity (-H) keeps long and short bursts apart: a process whose burst
+ * estimate is at least long_burst ticks queues as long, any other as
+ * short.  Big CPUs, those above the smallest capacity, serve the long
+ * queue first and little CPUs the short one, each falling back on the
+ * other queue rather than idle.
+ *
+ * A long burst stuck on a little CPU is given a slice of long_burst ticks,
+ * so it soon goes back to the queue, where a big CPU can take it.  And
+ * once imbalance long bursts wait, a waking long process preempts a big
+ * CPU running a short one, which moves to a little CPU.  placed[] counts
+ * dispatches by class and CPU size.
+ */
+#define BURST_LONG 0
+#define BURST_SHORT 1
+
+static pid_queue_t class_queues[2];
+static unsigned int long_burst, imbalance, min_capacity;
+static unsigned int placed[2][2], capacity_preemptions;
+
+/*
+ * Consolidation (-g <count>) packs the work onto as few CPUs as it can, so
+ * the others stay idle long enough to reach deep idle (see -E).  Only the
+ * CPUs below active_cpus take work; the rest are parked.  Once more than
+ * pack_wait processes wait beyond what the idle active CPUs will take, the
+ * next CPU is unparked, and the highest active CPU parks again when it
+ * finds nothing to run.  All of it is under rq_mutex; idle_cpus is only
+ * read, as a hint.
+ */
+static pid_queue_t pack_queue;
+static unsigned int pack_wait, active_cpus, unparks, parks;
+
+/*
+ * Gang scheduling (-G) runs the threads of a process together, for the
+ * threaded workload (-t), so a thread reaching a barrier finds the others
+ * running rather than queued behind other work.  Threads queue FIFO, but a
+ * CPU first takes a thread of a process already running on another CPU.
+ * And a thread waking up while another of its process runs preempts, if
+ * no CPU is idle, a CPU running a process with fewer threads running.
+ * gang_joins counts the dispatches of a thread alongside another of its
+ * process, out of gang_dispatches of threads of processes with several.
+ */
+static pid_queue_t gang_queue;
+static unsigned int gang_dispatches, gang_joins, gang_preemptions;
+
+/*
+ * An idle CPU first spins, watching ready_hint (set whenever any ready
+ * queue is non-empty) with a pause instruction, and only parks on no_idle
+ * if nothing turns up within its spin budget.  Catching work while
+ * spinning saves a futex sleep and wake-up, but burns host CPU, so each
+ * CPU sizes its budget from an EWMA of its recent wake gaps (host time
+ * from going idle to finding work): twice the typical gap if that is
+ * under spin_limit (-b), otherwise no spinning at all.  Times are host
+ * nanoseconds.  ready_since is when the ready queues last became
+ * non-empty, for the idle-to-run latency.  The rest is under rq_mutex.
+ */
+#define SPIN_LIMIT 50000
+#define WAKE_GAP_ALPHA 0.25
+
+static int ready_hint;
+static unsigned long long ready_since;
+static unsigned long long spin_limit;
+static unsigned long long *spin_budget;
+static double *wake_gap;
+static unsigned int wakes_spinning, wakes_parked;
+static unsigned long long spin_burn, idle_host_time;
+static unsigned long long latency_spinning, latency_parked, max_latency;
+
+/*
+ * Batched dispatch.  A CPU waiting in idle() has its bit in idle_waiting,
+ * under rq_mutex.  The first of them to find work takes work for the
+ * others too, in the same hold of rq_mutex: it claims them in
+ * claimed_cpus, fills in current[] for all of them under one hold of
+ * current_mutex, and hands the simulator the lot in one
+ * context_switch_batch().  A claimed CPU leaves idle() without scheduling
+ * once its bit shows up in published_cpus.  batches counts the dispatches
+ * of more than one CPU, and batched_cpus the CPUs dispatched by another.
+ */
+static unsigned int idle_waiting, claimed_cpus, published_cpus;
+static unsigned int batches, batched_cpus;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+
+
+static unsigned long long host_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull +
+        (unsigned long long)now.tv_nsec;
+}
+
+static int ready_empty(void)
+{
+    return edf_heap.size == 0 && sched.empty();
+}
+
+/*
+ * publish_ready() refreshes ready_hint for spinning idle CPUs.  Called with
+ * rq_mutex held after every change to the ready queues.
+ */
+static void publish_ready(void)
+{
+    int ready = !ready_empty();
+
+    if (ready && !__atomic_load_n(&ready_hint, __ATOMIC_RELAXED)) {
+        ready_since = host_now();
+    }
+    __atomic_store_n(&ready_hint, ready, __ATOMIC_RELEASE);
+}
+
+/*
+ * remaining_key() is the SRTF ordering key: how much longer the process's
+ * current CPU burst is expected to take, given it has been running since
+ * dispatch_time if now is later than that.
+ */
+static double remaining_key(const pcb_t *process, unsigned int now)
+{
+    double run;
+
+    if (predictive == 0) {
+        return process->time_remaining;
+    }
+
+    run = process->burst_run;
+    if (process->state == PROCESS_RUNNING) {
+        run += now - process->dispatch_time;
+    }
+    return process->burst_estimate - run;
+}
+
+static unsigned int priority_level(const pcb_t *process)
+{
+    return process->priority < PRIORITY_LEVELS ?
+        process->priority : PRIORITY_LEVELS - 1;
+}
+
+/*
+ * effective_priority() is the priority process runs at: its own, or under
+ * -I the highest of the processes waiting on its locks.
+ */
+static unsigned int effective_priority(const pcb_t *process)
+{
+    unsigned int lowest, highest;
+
+    if (inherit && lock_waiters(process, &lowest, &highest) > 0 &&
+        highest > process->priority) {
+        return highest;
+    }
+    return process->priority;
+}
+
+static double priority_key(const pcb_t *process)
+{
+    return (double)process->enqueue_time -
+        (double)effective_priority(process) *
+        (aging_ticks ? aging_ticks : 1000000.0);
+}
+
+/*
+ * track_running() moves cpu_id in the level_cpus[] and busy_levels bitmaps
+ * from the process in current[cpu_id] to process.  Called with
+ * current_mutex held.
+ */
+static void track_running(unsigned int cpu_id, const pcb_t *process)
+{
+    unsigned int bit = 1u << cpu_id, level;
+
+    if (current[cpu_id] != NULL) {
+        level = priority_level(current[cpu_id]);
+        level_cpus[level] &= ~bit;
+        if (level_cpus[level] == 0) {
+            busy_levels &= ~(1u << level);
+        }
+    } else {
+        idle_cpus &= ~bit;
+    }
+
+    if (process != NULL) {
+        level = priority_level(process);
+        level_cpus[level] |= bit;
+        busy_levels |= 1u << level;
+    } else {
+        idle_cpus |= bit;
+    }
+}
+
+/*
+ * group_of() returns the group of a process, creating it with weight 1 if
+ * no weight was given for its prefix.  Called with rq_mutex held, or
+ * before the simulation starts.
+ */
+static group_t *group_of(char prefix)
+{
+    group_t *group = groups[(unsigned char)prefix];
+
+    if (group == NULL) {
+        group = calloc(1, sizeof(group_t));
+        assert(group != NULL);
+        group->prefix = prefix;
+        group->weight = 1;
+        heap_init(&group->procs);
+        groups[(unsigned char)prefix] = group;
+    }
+    return group;
+}
+
+/*
+ * The built-in policies.  Their operations are called with rq_mutex held,
+ * except for on_wake, which is called with current_mutex held.
+ *
+ * FIFO / round-robin (the default, -r, -R): the linked ready queue.  With
+ * cache affinity (-a), affinity_pick_next() stands in for
+ * fifo_pick_next().
+ */
+static void fifo_enqueue(pcb_t *process)
+{
+    process->next = PID_NONE;
+
+    if (tail != PID_NONE) {
+        pcb_of(tail)->next = process->pid;
+    } else {
+        head = process->pid;
+    }
+    tail = process->pid;
+}
+
+static pcb_t *fifo_pick_next(unsigned int cpu_id)
+{
+    pcb_t *process;
+
+    if (head == PID_NONE) {
+        return NULL;
+    }
+
+    process = pcb_of(head);
+    head = process->next;
+    if (head == PID_NONE) {
+        tail = PID_NONE;
+    }
+    return process;
+}
+
+static int fifo_empty(void)
+{
+    return head == PID_NONE;
+}
+
+/*
+ * affinity_pick_next() removes the warmest process for cpu_id from the
+ * first AFFINITY_WINDOW entries of the ready queue, falling back to the
+ * head.  Every process it jumps over has its skips count raised; once the
+ * head has been skipped AFFINITY_MAX_SKIPS times it is taken regardless.
+ */
+static pcb_t *affinity_pick_next(unsigned int cpu_id)
+{
+    pcb_t *curr, *prev = NULL, *best = NULL, *best_prev = NULL;
+    unsigned int n, age, best_age = AFFINITY_WARM;
+
+    if (head != PID_NONE && pcb_of(head)->skips < AFFINITY_MAX_SKIPS) {
+        curr = pcb_of(head);
+        for (n = 0; curr != NULL && n < AFFINITY_WINDOW; n++) {
+            if (curr->warmth != 0 && curr->last_cpu == cpu_id) {
+                age = cpu_dispatches[cpu_id] - curr->warmth;
+                if (age < best_age) {
+                    best_age = age;
+                    best = curr;
+                    best_prev = prev;
+                }
+            }
+            prev = curr;
+            curr = curr->next != PID_NONE ? pcb_of(curr->next) : NULL;
+        }
+    }
+
+    if (best == NULL && head != PID_NONE) {
+        best = pcb_of(head);
+        best_prev = NULL;
+    }
+
+    if (best != NULL) {
+        for (curr = pcb_of(head); curr != best; curr = pcb_of(curr->next)) {
+            curr->skips++;
+        }
+        if (best_prev == NULL) {
+            head = best->next;
+        } else {
+            best_prev->next = best->next;
+        }
+        if (tail == best->pid) {
+            tail = best_prev != NULL ? best_prev->pid : PID_NONE;
+        }
+
+        best->skips = 0;
+        best->last_cpu = cpu_id;
+        best->warmth = ++cpu_dispatches[cpu_id];
+    }
+
+    return best;
+}
+
+/*
+ * The NUMA and capacity-aware policies keep several FIFO queues, each a
+ * pid_queue_t linked through the PCBs like the global one.  queue_remove()
+ * takes out the process after prev, or the head if prev is PID_NONE.
+ */
+static void queue_init(pid_queue_t *queue)
+{
+    queue->head = queue->tail = PID_NONE;
+    queue->length = 0;
+}
+
+static void queue_append(pid_queue_t *queue, pcb_t *process)
+{
+    process->next = PID_NONE;
+
+    if (queue->tail != PID_NONE) {
+        pcb_of(queue->tail)->next = process->pid;
+    } else {
+        queue->head = process->pid;
+    }
+    queue->tail = process->pid;
+    queue->length++;
+}
+
+static pcb_t *queue_take(pid_queue_t *queue)
+{
+    pcb_t *process;
+
+    if (queue->head == PID_NONE) {
+        return NULL;
+    }
+
+    process = pcb_of(queue->head);
+    queue->head = process->next;
+    if (queue->head == PID_NONE) {
+        queue->tail = PID_NONE;
+    }
+    queue->length--;
+    return process;
+}
+
+static pcb_t *queue_remove(pid_queue_t *queue, unsigned int prev)
+{
+    pcb_t *process;
+
+    if (prev == PID_NONE) {
+        return queue_take(queue);
+    }
+
+    process = pcb_of(pcb_of(prev)->next);
+    pcb_of(prev)->next = process->next;
+    if (queue->tail == process->pid) {
+        queue->tail = prev;
+    }
+    queue->length--;
+    return process;
+}
+
+static int numa_init(unsigned int cpus, const char *args)
+{
+    nodes = node_count();
+    node_queues = malloc(sizeof(pid_queue_t) * nodes);
+    assert(node_queues != NULL);
+    for (unsigned int node = 0; node < nodes; node++) {
+        queue_init(&node_queues[node]);
+    }
+    return 0;
+}
+
+static void numa_enqueue(pcb_t *process)
+{
+    int home = process_node(process);
+    unsigned int node = 0;
+
+    if (home >= 0) {
+        node = (unsigned int)home;
+    } else {
+        for (unsigned int n = 1; n < nodes; n++) {
+            if (node_queues[n].length < node_queues[node].length) {
+                node = n;
+            }
+        }
+    }
+    queue_append(&node_queues[node], process);
+}
+
+static pcb_t *numa_pick_next(unsigned int cpu_id)
+{
+    unsigned int node = cpu_node(cpu_id);
+
+    if (node_queues[node].length > 0) {
+        node_local++;
+    } else {
+        for (unsigned int n = 0; n < nodes; n++) {
+            if (node_queues[n].length > node_queues[node].length) {
+                node = n;
+            }
+        }
+        if (node_queues[node].length == 0) {
+            return NULL;
+        }
+        node_steals++;
+    }
+    return queue_take(&node_queues[node]);
+}
+
+static int numa_empty(void)
+{
+    for (unsigned int node = 0; node < nodes; node++) {
+        if (node_queues[node].length > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void numa_print_stats(void)
+{
+    printf("Dispatches from the CPU's own node: %u, stolen from another: "
+        "%u\n", node_local, node_steals);
+}
+
+/*
+ * Priority (-p) and shortest-remaining-time-first (-s, -e) share rq_heap,
+ * and differ only in its key and in whom a waking process preempts.
+ */
+static pcb_t *rq_pick_next(unsigned int cpu_id)
+{
+    return heap_pop(&rq_heap);
+}
+
+static int rq_empty(void)
+{
+    return rq_heap.size == 0;
+}
+
+static void priority_enqueue(pcb_t *process)
+{
+    heap_push(&rq_heap, priority_key(process), process);
+}
+
+static pcb_t *priority_pick_next(unsigned int cpu_id)
+{
+    pcb_t *process = heap_pop(&rq_heap);
+    unsigned int wait, level;
+
+    if (process != NULL) {
+        wait = get_simulator_time() - process->enqueue_time;
+        level = priority_level(process);
+        if (wait > max_wait[level]) {
+            max_wait[level] = wait;
+        }
+    }
+    return process;
+}
+
+/*
+ * priority_on_wake() picks a CPU running the lowest priority, if that is
+ * below the process that just woke and no CPU is idle.  The lookup is two
+ * find-first-set operations, on busy_levels and then level_cpus[].
+ */
+static int priority_on_wake(const pcb_t *process)
+{
+    unsigned int level, priority, lowest = UINT_MAX;
+    int victim = -1;
+
+    if (idle_cpus != 0 || busy_levels == 0) {
+        return -1;
+    }
+
+    if (inherit) {
+        /* Inherited priorities change under the bitmaps */
+        for (unsigned int cpu = 0; cpu < cpu_count; cpu++) {
+            if (current[cpu] == NULL) {
+                continue;
+            }
+            priority = effective_priority(current[cpu]);
+            if (priority < lowest) {
+                lowest = priority;
+                victim = (int)cpu;
+            }
+        }
+        return lowest < effective_priority(process) ? victim : -1;
+    }
+
+    level = (unsigned int)__builtin_ctz(busy_levels);
+    if (level < priority_level(process)) {
+        return __builtin_ctz(level_cpus[level]);
+    }
+    return -1;
+}
+
+/*
+ * priority_on_yield() lends the priority of a process that just blocked on
+ * a lock to the chain of holders in front of it: each one waiting in
+ * rq_heap is queued again under its new key.  Called with rq_mutex held.
+ */
+static void priority_on_yield(pcb_t *process, unsigned int ran)
+{
+    unsigned int holder = PID_NONE;
+    pcb_t *blocker;
+
+    (void)ran;
+    if (inherit && process->state == PROCESS_WAITING) {
+        holder = lock_holder(process);
+    }
+
+    while (holder != PID_NONE) {
+        blocker = pcb_of(holder);
+        if (blocker->state == PROCESS_READY &&
+            heap_remove(&rq_heap, blocker)) {
+            heap_push(&rq_heap, priority_key(blocker), blocker);
+            priority_boosts++;
+        }
+        holder = lock_holder(blocker);
+    }
+}
+
+static void priority_print_stats(void)
+{
+    if (inherit) {
+        printf("Priority boosts of lock holders: %u\n", priority_boosts);
+    }
+    for (unsigned int level = 0; level < PRIORITY_LEVELS; level++) {
+        if (max_wait[level] > 0) {
+            printf("Max READY wait at priority %u: %.1f s\n", level,
+                (float)max_wait[level] / 10.0);
+        }
+    }
+}
+
+static void srtf_enqueue(pcb_t *process)
+{
+    heap_push(&rq_heap, remaining_key(process, 0), process);
+}
+
+/*
+ * srtf_on_wake() picks the CPU with the longest remaining burst, if that is
+ * longer than the waking process's and no CPU is idle.
+ */
+static int srtf_on_wake(const pcb_t *process)
+{
+    unsigned int now = get_simulator_time();
+    double key = remaining_key(process, now), worst = key;
+    int victim = -1;
+
+    for (unsigned int i = 0; i < cpu_count; i++) {
+        if (current[i] == NULL) {
+            return -1;
+        }
+        if (remaining_key(current[i], now) > worst) {
+            worst = remaining_key(current[i], now);
+            victim = (int)i;
+        }
+    }
+    return victim;
+}
+
+static void srtf_print_stats(void)
+{
+    if (predictive == 1 && predictions > 0) {
+        printf("Mean burst prediction error: %.2f ticks over %u bursts\n",
+            prediction_error / predictions, predictions);
+    }
+}
+
+/*
+ * Fair share (-f): fair_push() and fair_pop() are the two levels of the
+ * queue, and fair_charge() bills CPU time to a process and its group.
+ */
+static void fair_push(pcb_t *process)
+{
+    group_t *group = group_of(process_name(process)[0]);
+
+    if (process->vruntime < group->min_vruntime) {
+        process->vruntime = group->min_vruntime;
+    }
+    heap_push(&group->procs, process->vruntime, process);
+
+    if (!group->queued) {
+        if (group->vruntime < min_group_vruntime) {
+            group->vruntime = min_group_vruntime;
+        }
+        heap_push(&group_heap, group->vruntime, group);
+        group->queued = 1;
+    }
+}
+
+static pcb_t *fair_pop(unsigned int cpu_id)
+{
+    const heap_entry_t *top;
+    group_t *group;
+    pcb_t *process;
+
+    while ((top = heap_peek(&group_heap)) != NULL) {
+        group = top->item;
+        if (top->key == group->vruntime) {
+            break;
+        }
+        heap_pop(&group_heap);
+        heap_push(&group_heap, group->vruntime, group);
+    }
+    if (top == NULL) {
+        return NULL;
+    }
 
+    group = heap_pop(&group_heap);
+    min_group_vruntime = group->vruntime;
+    process = heap_pop(&group->procs);
+    group->min_vruntime = process->vruntime;
 
+    if (group->procs.size > 0) {
+        heap_push(&group_heap, group->vruntime, group);
+    } else {
+        group->queued = 0;
+    }
+    return process;
+}
 
-static void push(pcb_t* readyQueue)
+static int fair_empty(void)
 {
-    /* FIFO or ROUND-ROBIN */
-    pthread_mutex_lock(&rq_mutex);
+    return group_heap.size == 0;
+}
 
-    pcb_t *curr_pcb = head;
+static void fair_charge(pcb_t *process, unsigned int ran)
+{
+    group_t *group = group_of(process_name(process)[0]);
 
-    readyQueue->next = NULL;
+    process->vruntime += ran;
+    group->cpu_time += ran;
+    group->vruntime += (double)ran / group->weight;
+}
 
-    if (curr_pcb != NULL) {
+static void fair_print_stats(void)
+{
+    unsigned long total = 0;
 
-        while (curr_pcb->next != NULL) {
-            curr_pcb = curr_pcb->next;
+    for (unsigned int g = 0; g <= UCHAR_MAX; g++) {
+        total += groups[g] != NULL ? groups[g]->cpu_time : 0;
+    }
+    for (unsigned int g = 0; g <= UCHAR_MAX; g++) {
+        if (groups[g] != NULL && total > 0) {
+            printf("Group %c (weight %u): %.1f s CPU, %.1f%% share\n",
+                groups[g]->prefix, groups[g]->weight,
+                (float)groups[g]->cpu_time / 10.0,
+                100.0 * (double)groups[g]->cpu_time / (double)total);
         }
+    }
+}
+
+static const sched_ops_t fifo_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "fifo",
+    .enqueue = fifo_enqueue,
+    .pick_next = fifo_pick_next,
+    .empty = fifo_empty
+};
+
+static const sched_ops_t numa_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "numa",
+    .init = numa_init,
+    .enqueue = numa_enqueue,
+    .pick_next = numa_pick_next,
+    .empty = numa_empty,
+    .print_stats = numa_print_stats
+};
+
+static const sched_ops_t priority_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "priority",
+    .enqueue = priority_enqueue,
+    .pick_next = priority_pick_next,
+    .empty = rq_empty,
+    .on_wake = priority_on_wake,
+    .on_yield = priority_on_yield,
+    .print_stats = priority_print_stats
+};
+
+static const sched_ops_t srtf_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "srtf",
+    .enqueue = srtf_enqueue,
+    .pick_next = rq_pick_next,
+    .empty = rq_empty,
+    .on_wake = srtf_on_wake,
+    .print_stats = srtf_print_stats
+};
+
+static const sched_ops_t fair_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "fair",
+    .enqueue = fair_push,
+    .pick_next = fair_pop,
+    .empty = fair_empty,
+    .on_preempt = fair_charge,
+    .on_yield = fair_charge,
+    .print_stats = fair_print_stats
+};
 
-        curr_pcb->next = readyQueue;
+/*
+ * What a policy leaves out: no bookkeeping, no preemption on wake-up, the
+ * time slice the options give (the fixed TimeSlice, or under adaptive
+ * round-robin the part of its predicted burst the process has not run
+ * yet) and no statistics.
+ */
+static void no_charge(pcb_t *process, unsigned int ran)
+{
+}
+
+static int no_wake(const pcb_t *process)
+{
+    return -1;
+}
+
+static int fixed_timeslice(const pcb_t *process)
+{
+    return TimeSlice;
+}
+
+static int adaptive_timeslice(const pcb_t *process)
+{
+    unsigned int slice;
+    float predicted;
+
+    predicted = process->burst_estimate * 1.25f + 1.0f;
+    if (predicted > (float)process->burst_run) {
+        slice = (unsigned int)(predicted - (float)process->burst_run);
     } else {
-        head = readyQueue;
+        slice = slice_min;
     }
 
-    pthread_cond_broadcast(&no_idle);
-    pthread_mutex_unlock(&rq_mutex);
+    if (slice < slice_min) {
+        slice = slice_min;
+    }
+    if (slice > slice_max) {
+        slice = slice_max;
+    }
+    return (int)slice;
 }
 
-static pcb_t* pop()
+static void no_stats(void)
 {
+}
 
-    pcb_t* popReadyQueue;
-    pthread_mutex_lock(&rq_mutex);
+/*
+ * Capacity-aware (-k): see class_queues above.  It comes after the
+ * defaults because a long burst on a big CPU keeps the usual time slice.
+ */
+static unsigned int burst_class(const pcb_t *process)
+{
+    return process->burst_estimate >= (float)long_burst ?
+        BURST_LONG : BURST_SHORT;
+}
 
-    popReadyQueue = head;
+static int big_cpu(unsigned int cpu_id)
+{
+    return cpu_capacity(cpu_id) > min_capacity;
+}
 
-    if (popReadyQueue != NULL)
-    {
-        head = popReadyQueue->next;
+static int capacity_init(unsigned int cpus, const char *args)
+{
+    min_capacity = cpu_capacity(0);
+    for (unsigned int cpu = 1; cpu < cpus; cpu++) {
+        if (cpu_capacity(cpu) < min_capacity) {
+            min_capacity = cpu_capacity(cpu);
+        }
     }
+    queue_init(&class_queues[BURST_LONG]);
+    queue_init(&class_queues[BURST_SHORT]);
+    return 0;
+}
 
-    pthread_mutex_unlock(&rq_mutex);
-    return popReadyQueue;
+static void capacity_enqueue(pcb_t *process)
+{
+    queue_append(&class_queues[burst_class(process)], process);
+}
+
+static pcb_t *capacity_pick_next(unsigned int cpu_id)
+{
+    unsigned int own = big_cpu(cpu_id) ? BURST_LONG : BURST_SHORT;
+    pcb_t *process = queue_take(&class_queues[own]);
+
+    if (process == NULL) {
+        process = queue_take(&class_queues[1 - own]);
+    }
+    if (process != NULL) {
+        process->last_cpu = cpu_id;
+        placed[burst_class(process)][big_cpu(cpu_id)]++;
+    }
+    return process;
+}
+
+static int capacity_empty(void)
+{
+    return class_queues[BURST_LONG].length == 0 &&
+        class_queues[BURST_SHORT].length == 0;
+}
+
+/*
+ * capacity_on_wake() frees a big CPU for long work once imbalance long
+ * bursts wait, by preempting the big CPU running the shortest burst
+ * estimate, if that is a short one and no CPU is idle.
+ */
+static int capacity_on_wake(const pcb_t *process)
+{
+    const pcb_t *running;
+    int victim = -1;
+
+    if (burst_class(process) != BURST_LONG ||
+        class_queues[BURST_LONG].length < imbalance) {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < cpu_count; i++) {
+        running = sched_running(i);
+        if (running == NULL) {
+            return -1;
+        }
+        if (big_cpu(i) && burst_class(running) == BURST_SHORT &&
+            (victim < 0 || running->burst_estimate <
+             sched_running((unsigned int)victim)->burst_estimate)) {
+            victim = (int)i;
+        }
+    }
+    if (victim >= 0) {
+        capacity_preemptions++;
+    }
+    return victim;
+}
+
+static int capacity_timeslice(const pcb_t *process)
+{
+    if (burst_class(process) == BURST_LONG && !big_cpu(process->last_cpu) &&
+        (TimeSlice < 0 || (unsigned int)TimeSlice > long_burst)) {
+        return (int)long_burst;
+    }
+    return adaptive ? adaptive_timeslice(process) : TimeSlice;
+}
+
+static void capacity_print_stats(void)
+{
+    printf("Long bursts dispatched: %u on big CPUs, %u on little ones\n",
+        placed[BURST_LONG][1], placed[BURST_LONG][0]);
+    printf("Short bursts dispatched: %u on big CPUs, %u on little ones\n",
+        placed[BURST_SHORT][1], placed[BURST_SHORT][0]);
+    printf("Big CPUs freed for long bursts: %u\n", capacity_preemptions);
+}
+
+static const sched_ops_t capacity_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "capacity",
+    .init = capacity_init,
+    .enqueue = capacity_enqueue,
+    .pick_next = capacity_pick_next,
+    .empty = capacity_empty,
+    .on_wake = capacity_on_wake,
+    .timeslice_for = capacity_timeslice,
+    .print_stats = capacity_print_stats
+};
+
+/*
+ * Consolidation (-g): see pack_queue above.
+ */
+static void pack_set_active(unsigned int count)
+{
+    active_cpus = count;
+    for (unsigned int cpu = 0; cpu < cpu_count; cpu++) {
+        set_cpu_parked(cpu, cpu >= active_cpus);
+    }
+}
+
+static int pack_init(unsigned int cpus, const char *args)
+{
+    queue_init(&pack_queue);
+    pack_set_active(1);
+    return 0;
+}
+
+static void pack_enqueue(pcb_t *process)
+{
+    unsigned int idle = (unsigned int)__builtin_popcount(idle_cpus &
+        ((1u << active_cpus) - 1));
+
+    queue_append(&pack_queue, process);
+    if (pack_queue.length > pack_wait + idle && active_cpus < cpu_count) {
+        set_cpu_parked(active_cpus++, 0);
+        unparks++;
+    }
+}
+
+static pcb_t *pack_pick_next(unsigned int cpu_id)
+{
+    pcb_t *process = queue_take(&pack_queue);
+
+    if (process == NULL && cpu_id > 0 && cpu_id + 1 == active_cpus) {
+        set_cpu_parked(--active_cpus, 1);
+        parks++;
+    }
+    return process;
+}
+
+static int pack_empty(void)
+{
+    return pack_queue.length == 0;
+}
+
+static void pack_print_stats(void)
+{
+    printf("CPUs unparked: %u times, parked: %u times, %u in use at the "
+        "end\n", unparks, parks, active_cpus);
+}
+
+static const sched_ops_t pack_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "pack",
+    .init = pack_init,
+    .enqueue = pack_enqueue,
+    .pick_next = pack_pick_next,
+    .empty = pack_empty,
+    .print_stats = pack_print_stats
+};
+
+/*
+ * Gang scheduling (-G): see gang_queue above.
+ */
+static int gang_init(unsigned int cpus, const char *args)
+{
+    queue_init(&gang_queue);
+    return 0;
+}
+
+static void gang_enqueue(pcb_t *process)
+{
+    queue_append(&gang_queue, process);
+}
+
+/*
+ * gang_pick_next() takes the first thread of a process running on another
+ * CPU, or else the head of the queue.  It looks at current[] under
+ * current_mutex, which is never held while waiting for rq_mutex.
+ */
+static pcb_t *gang_pick_next(unsigned int cpu_id)
+{
+    unsigned int running[16], count = 0, prev = PID_NONE, pid;
+    pcb_t *process;
+
+    PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
+    for (unsigned int cpu = 0; cpu < cpu_count; cpu++) {
+        if (cpu != cpu_id && current[cpu] != NULL &&
+            thread_count(current[cpu]) > 1) {
+            running[count++] = thread_group(current[cpu]);
+        }
+    }
+    pthread_mutex_unlock(&current_mutex);
+
+    for (pid = gang_queue.head; pid != PID_NONE; pid = pcb_of(pid)->next) {
+        unsigned int k = 0;
+
+        while (k < count && running[k] != thread_group(pcb_of(pid))) {
+            k++;
+        }
+        if (k < count) {
+            break;
+        }
+        prev = pid;
+    }
+    if (pid == PID_NONE) {
+        prev = PID_NONE;
+    }
+
+    process = queue_remove(&gang_queue, prev);
+    if (process != NULL && thread_count(process) > 1) {
+        gang_dispatches++;
+        gang_joins += pid != PID_NONE;
+    }
+    return process;
+}
+
+static int gang_empty(void)
+{
+    return gang_queue.length == 0;
+}
+
+/*
+ * gang_on_wake() makes room for a thread whose process is running: with no
+ * CPU idle, it preempts the CPU running the process with the fewest of its
+ * threads running, if that is fewer than this process would then have.
+ */
+static int gang_on_wake(const pcb_t *process)
+{
+    unsigned int group = thread_group(process), mates = 0, fewest = 0;
+    unsigned int others;
+    const pcb_t *running;
+    int victim = -1;
+
+    if (thread_count(process) == 1) {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < cpu_count; i++) {
+        running = sched_running(i);
+        if (running == NULL) {
+            return -1;
+        }
+        mates += thread_group(running) == group;
+    }
+    if (mates == 0) {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < cpu_count; i++) {
+        if (thread_group(sched_running(i)) == group) {
+            continue;
+        }
+        others = 0;
+        for (unsigned int j = 0; j < cpu_count; j++) {
+            others += thread_group(sched_running(j)) ==
+                thread_group(sched_running(i));
+        }
+        if (others <= mates && (victim < 0 || others < fewest)) {
+            victim = (int)i;
+            fewest = others;
+        }
+    }
+    if (victim >= 0) {
+        gang_preemptions++;
+    }
+    return victim;
+}
+
+static void gang_print_stats(void)
+{
+    printf("Threads dispatched alongside another of their process: %u of "
+        "%u\n", gang_joins, gang_dispatches);
+    printf("CPUs preempted to run a process's threads together: %u\n",
+        gang_preemptions);
 }
 
+static const sched_ops_t gang_ops = {
+    .version = SCHED_OPS_VERSION,
+    .name = "gang",
+    .init = gang_init,
+    .enqueue = gang_enqueue,
+    .pick_next = gang_pick_next,
+    .empty = gang_empty,
+    .on_wake = gang_on_wake,
+    .print_stats = gang_print_stats
+};
 
-static pcb_t* priority_queue() {
+/*
+ * load_policy() loads a policy from the shared object path, which must
+ * export its table as sched_ops.  Returns NULL, having said why, if it
+ * cannot be used.
+ */
+static const sched_ops_t *load_policy(const char *path)
+{
+    const sched_ops_t *ops;
+    void *module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
 
-    pcb_t *curr = NULL;
-    pcb_t *highest = NULL;
-    curr = head;
-    unsigned int level = 0;
+    if (module == NULL) {
+        fprintf(stderr, "%s\n", dlerror());
+        return NULL;
+    }
 
-    if (head == NULL) {
+    ops = dlsym(module, "sched_ops");
+    if (ops == NULL) {
+        fprintf(stderr, "%s: no sched_ops table\n", path);
+        return NULL;
+    }
+    if (ops->version != SCHED_OPS_VERSION || ops->enqueue == NULL ||
+        ops->pick_next == NULL || ops->empty == NULL) {
+        fprintf(stderr, "%s: unusable sched_ops table\n", path);
         return NULL;
     }
+    return ops;
+}
+
+/*
+ * use_policy() puts ops in force, filling in what it leaves out.
+ */
+static void use_policy(const sched_ops_t *ops)
+{
+    sched = *ops;
+    sched_table = ops;
+
+    if (sched.name == NULL) {
+        sched.name = "custom";
+    }
+    if (sched.on_preempt == NULL) {
+        sched.on_preempt = no_charge;
+    }
+    if (sched.on_yield == NULL) {
+        sched.on_yield = no_charge;
+    }
+    if (sched.on_wake == NULL) {
+        sched.on_wake = no_wake;
+    }
+    if (sched.timeslice_for == NULL) {
+        sched.timeslice_for = adaptive ? adaptive_timeslice : fixed_timeslice;
+    }
+    if (sched.print_stats == NULL) {
+        sched.print_stats = no_stats;
+    }
+    if (affinity == 1 && ops == &fifo_ops) {
+        sched.pick_next = affinity_pick_next;
+    }
+}
+
+extern unsigned int sched_cpu_count(void)
+{
+    return cpu_count;
+}
+
+extern const pcb_t *sched_running(unsigned int cpu_id)
+{
+    return current[cpu_id];
+}
 
-    if(head->next == NULL){
-        head = NULL;
-        return curr;
+/*
+ * queue_ready() puts a ready process in the ready queues: jobs with a
+ * deadline in edf_heap under -d, everything else with the policy.  Called
+ * with rq_mutex held.
+ */
+static void queue_ready(pcb_t *process)
+{
+    if (edf == 1 && process->deadline != 0) {
+        heap_push(&edf_heap, process->abs_deadline, process);
     } else {
-        while (curr != NULL) {
-            if (curr->priority > level) {
-                level = curr->priority;
-                highest = curr;
-            }
-            curr = curr->next;
+        sched.enqueue(process);
+    }
+}
+
+static void push(pcb_t* readyQueue)
+{
+    readyQueue->enqueue_time = get_simulator_time();
+
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    queue_ready(readyQueue);
+    publish_ready();
+    pthread_cond_broadcast(&no_idle);
+    pthread_mutex_unlock(&rq_mutex);
+}
+
+/*
+ * pick_ready() removes the process CPU cpu_id is to run next from the ready
+ * queues, or returns NULL if there is none for it.  Called with rq_mutex
+ * held.
+ */
+static pcb_t *pick_ready(unsigned int cpu_id)
+{
+    pcb_t *process = NULL;
+
+    /* Real-time work always goes first */
+    if (edf == 1) {
+        process = heap_pop(&edf_heap);
+    }
+    if (process == NULL) {
+        process = sched.pick_next(cpu_id);
+    }
+    return process;
+}
+
+/* start_running() marks a process picked for a CPU as running */
+static void start_running(pcb_t *process)
+{
+    process->state = PROCESS_RUNNING;
+    process->dispatch_time = get_simulator_time();
+    process->slices++;
+}
+
+/*
+ * job_done() records whether the job a deadline process just finished met
+ * its deadline, and by how much it missed.
+ */
+static void job_done(const pcb_t *process)
+{
+    unsigned int now, lateness = 0, bucket = 0;
+
+    if (process->deadline == 0) {
+        return;
+    }
+
+    now = get_simulator_time();
+    if (now > process->abs_deadline) {
+        lateness = now - process->abs_deadline;
+        while (bucket < LATENESS_BUCKETS - 1 && (1u << bucket) <= lateness) {
+            bucket++;
+        }
+    }
+
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    jobs_done++;
+    lateness_hist[bucket]++;
+    if (lateness > 0) {
+        jobs_missed++;
+        total_lateness += lateness;
+        if (lateness > max_lateness) {
+            max_lateness = lateness;
+        }
+    }
+    pthread_mutex_unlock(&rq_mutex);
+}
+
+/*
+ * end_slice() charges the time since dispatch to the process's current
+ * burst, and tells the policy.  A preempted burst is not over, but it is at
+ * least as long as what has run so far, so the estimate is raised to match.
+ * A burst ending in yield() is folded into the EWMA.
+ */
+static void end_slice(pcb_t *process, int burst_done)
+{
+    unsigned int ran = get_simulator_time() - process->dispatch_time;
+
+    /* Handlers run concurrently; the shared counters go under rq_mutex */
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    if (burst_done) {
+        sched.on_yield(process, ran);
+    } else {
+        sched.on_preempt(process, ran);
+    }
+    process->burst_run += ran;
+    if (burst_done) {
+        if (process->burst_estimate > 0.0f) {
+            prediction_error += fabs(process->burst_estimate -
+                (double)process->burst_run);
+            predictions++;
         }
-        curr = head;
-        if (highest == head) {
-            head = head->next;
-            return highest;
+        bursts_total++;
+        if (process->slices == 1) {
+            bursts_one_slice++;
         }
+    }
+    pthread_mutex_unlock(&rq_mutex);
 
-        while (curr->next != highest) {
-            curr = curr->next;
+    if (!burst_done) {
+        if ((float)process->burst_run > process->burst_estimate) {
+            process->burst_estimate = (float)process->burst_run;
         }
-        curr->next = highest->next;
+        return;
     }
-return highest;
+
+    process->burst_estimate = burst_alpha * (float)process->burst_run +
+        (1.0f - burst_alpha) * process->burst_estimate;
+
+    process->burst_run = 0;
+    process->slices = 0;
 }
 
 void help()
 {
     fprintf(stderr, "CS 2200 Project 4 -- Multithreaded OS Simulator\n"
-            "Usage: ./os-sim <# CPUs> [ -r <time slice> | -p ]\n"
+            "Usage: ./os-sim <# CPUs> [ -r <time slice> | -R <min>:<max> | -p |\n"
+            "                  -s | -e <alpha> ]\n"
+            "                [ -w <ticks> ] [ -f <groups> ] [ -d ] [ -a ] [ -S <seed> ] [ -D ]\n"
+            "                [ -c <ticks> ] [ -m <ticks> ] [ -i <ticks> ] [ -b <us> ]\n"
+            "                [ -A <arrivals> [ -n <count> ] [ -T <ticks> ] ]\n"
+            "                [ -P <sched.so>[:<args>] ] [ -C <tick>:<file> ] [ -L <file> ]\n"
+            "                [ -M <shm name> ] [ -N <sockets>x<cores>x<threads>[:<%%>] ]\n"
+            "                [ -H <%%>[,<%%>...] ] [ -k <ticks>[:<count>] ]\n"
+            "                [ -E <ticks>[:<ticks>[:<ticks>]] ] [ -F <%%>[,<%%>...] ]\n"
+            "                [ -g <count> ] [ -t ] [ -G ] [ -I ]\n"
             "    Default : FIFO Scheduler\n"
             "         -r : Round-Robin Scheduler\n"
-            "         -p : Priority Scheduler\n\n");
+            "         -R : Round-Robin with slices adapted to burst lengths\n"
+            "         -p : Priority Scheduler\n"
+            "         -w : Ticks a waiting process needs to gain one priority\n"
+            "              level under -p (default 10, 0 disables aging)\n"
+            "         -s : Shortest Remaining Time First (oracle)\n"
+            "         -e : SRTF on bursts predicted by exponential averaging\n"
+            "         -f : Fair share between process groups, named by the\n"
+            "              first letter of the process name: -f I=3,C=1\n"
+            "         -d : Earliest-deadline-first for processes with deadlines\n"
+            "         -a : Prefer processes with a warm cache on the CPU\n"
+            "              (FIFO and round-robin)\n"
+            "         -S : Workload seed (shuffles process creation order)\n"
+            "         -D : Deterministic mode (repeatable multi-CPU runs)\n"
+            "         -c : Context switch cost\n"
+            "         -m : Extra cost of resuming on a different CPU\n"
+            "         -i : Cost of switching to or from idle\n"
+            "         -b : Longest an idle CPU spins before parking, in host\n"
+            "              microseconds (default 50, 0 parks at once)\n"
+            "         -A : Open arrivals: poisson:<rate/s>,\n"
+            "              onoff:<rate/s>:<on ticks>:<off ticks> or trace:<file>\n"
+            "         -n : Stop arrivals after this many processes\n"
+            "         -T : End the simulation at this tick\n"
+            "         -P : Load the scheduling policy from a shared object,\n"
+            "              passing it <args> (see src/sched-ops.h)\n"
+            "         -C : Save a checkpoint to <file> at the start of <tick>\n"
+            "              (needs -D)\n"
+            "         -L : Start from the checkpoint in <file> (needs -D; the\n"
+            "              scheduling options may differ from the saved run)\n"
+            "         -M : Publish live counters in a shared memory segment\n"
+            "              (read them with ./os-metrics)\n"
+            "         -N : NUMA topology, one node per socket; a process runs\n"
+            "              <%%> slower off its home node (default 50).  FIFO\n"
+            "              and round-robin then queue per node\n"
+            "         -H : CPU capacities in percent of a nominal CPU, from\n"
+            "              CPU 0 on; the last one given repeats: -H 200,50\n"
+            "         -k : Capacity-aware: bursts of <ticks> or more go to the\n"
+            "              big CPUs, and preempt short ones there once\n"
+            "              <count> wait (default 1)\n"
+            "         -E : Energy model: idle CPUs drop to deep idle after\n"
+            "              <deep after> ticks, and take <deep exit> (default\n"
+            "              2) or <shallow exit> (default 0) ticks to wake\n"
+            "         -F : CPU frequencies in percent of nominal, from CPU 0\n"
+            "              on; the last one given repeats\n"
+            "         -g : Consolidation: pack work onto as few CPUs as\n"
+            "              possible, waking another once more than <count>\n"
+            "              processes wait\n"
+            "         -t : Threaded workload: processes of several threads\n"
+            "              that meet at barriers and share locks\n"
+            "         -G : Gang scheduling: run the threads of a process\n"
+            "              together\n"
+            "         -I : Priority inheritance under -p: a lock holder runs\n"
+            "              at the priority of its highest waiter\n\n");
 }
 
 
@@ -160,21 +1545,86 @@ static void schedule(unsigned int cpu_id)
 {
     pcb_t *removeNode;
 
-    if (prior == 1) {
-        removeNode = priority_queue();
-    } else {
-        removeNode = pop();
-    }
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    removeNode = pick_ready(cpu_id);
+    publish_ready();
+    pthread_mutex_unlock(&rq_mutex);
 
     if (removeNode != NULL) {
-        removeNode->state = PROCESS_RUNNING;
+        start_running(removeNode);
     }
 
-    pthread_mutex_lock(&current_mutex);
+    PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
+    track_running(cpu_id, removeNode);
     current[cpu_id] = removeNode;
 
     pthread_mutex_unlock(&current_mutex);
-    context_switch(cpu_id, removeNode, TimeSlice);
+    context_switch(cpu_id, removeNode,
+        removeNode != NULL ? sched.timeslice_for(removeNode) : TimeSlice);
+}
+
+
+/*
+ * dispatch_idle() is schedule() for a CPU leaving idle() with work to do.
+ * In the same pass over the ready queues it picks work for every other CPU
+ * waiting in idle(), lowest numbered first, while there is any, and
+ * dispatches them all together.  Called with rq_mutex held, which it
+ * releases.
+ */
+static void dispatch_idle(unsigned int cpu_id)
+{
+    unsigned int cpus[16], count = 1, waiting = idle_waiting, n;
+    pcb_t *picked[16], *process;
+    int slices[16];
+
+    cpus[0] = cpu_id;
+    picked[0] = pick_ready(cpu_id);
+    while (waiting != 0 && !ready_empty()) {
+        n = (unsigned int)__builtin_ctz(waiting);
+        waiting &= waiting - 1;
+        if (cpu_parked(n)) {
+            continue;
+        }
+        process = pick_ready(n);
+        if (process != NULL) {
+            idle_waiting &= ~(1u << n);
+            claimed_cpus |= 1u << n;
+            cpus[count] = n;
+            picked[count++] = process;
+        }
+    }
+    publish_ready();
+    pthread_mutex_unlock(&rq_mutex);
+
+    PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
+    for (n = 0; n < count; n++) {
+        if (picked[n] != NULL) {
+            start_running(picked[n]);
+        }
+        track_running(cpus[n], picked[n]);
+        current[cpus[n]] = picked[n];
+    }
+    pthread_mutex_unlock(&current_mutex);
+
+    for (n = 0; n < count; n++) {
+        slices[n] = picked[n] != NULL ?
+            sched.timeslice_for(picked[n]) : TimeSlice;
+    }
+    if (count == 1) {
+        context_switch(cpu_id, picked[0], slices[0]);
+        return;
+    }
+    context_switch_batch(count, cpus, picked, slices);
+
+    /* Let the CPUs just dispatched out of idle() */
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    for (n = 1; n < count; n++) {
+        published_cpus |= 1u << cpus[n];
+    }
+    batches++;
+    batched_cpus += count - 1;
+    pthread_cond_broadcast(&no_idle);
+    pthread_mutex_unlock(&rq_mutex);
 }
 
 
@@ -187,15 +1637,65 @@ static void schedule(unsigned int cpu_id)
  */
 extern void idle(unsigned int cpu_id)
 {
+    unsigned long long start = host_now(), now = start, since, gap;
+    unsigned int bit = 1u << cpu_id;
+    int parked = 0;
+
+    /* Spin while the budget lasts, then park */
+    while (!__atomic_load_n(&ready_hint, __ATOMIC_ACQUIRE) &&
+           now - start < spin_budget[cpu_id])
+    {
+        cpu_relax();
+        now = host_now();
+    }
 
-    pthread_mutex_lock(&rq_mutex);
-    while (head == NULL)
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    spin_burn += now - start;
+    idle_waiting |= bit;
+    while (!(claimed_cpus & bit) && (ready_empty() || cpu_parked(cpu_id)))
     {
+        parked = 1;
         pthread_cond_wait(&no_idle, &rq_mutex);
     }
 
-    pthread_mutex_unlock(&rq_mutex);
-    schedule(cpu_id);
+    /* Learn from this wake gap, and account for the wait */
+    now = host_now();
+    gap = now - start;
+    wake_gap[cpu_id] = WAKE_GAP_ALPHA * (double)gap +
+        (1.0 - WAKE_GAP_ALPHA) * wake_gap[cpu_id];
+    spin_budget[cpu_id] = (wake_gap[cpu_id] < (double)spin_limit) ?
+        (unsigned long long)(2.0 * wake_gap[cpu_id]) : 0;
+    if (spin_budget[cpu_id] > spin_limit) {
+        spin_budget[cpu_id] = spin_limit;
+    }
+
+    since = (ready_since > start) ? ready_since : start;
+    since = now > since ? now - since : 0;
+    if (parked) {
+        wakes_parked++;
+        latency_parked += since;
+    } else {
+        wakes_spinning++;
+        latency_spinning += since;
+    }
+    if (since > max_latency) {
+        max_latency = since;
+    }
+    idle_host_time += gap;
+
+    /* Another CPU dispatched this one; wait until the simulator has it */
+    if (claimed_cpus & bit) {
+        while (!(published_cpus & bit)) {
+            pthread_cond_wait(&no_idle, &rq_mutex);
+        }
+        claimed_cpus &= ~bit;
+        published_cpus &= ~bit;
+        pthread_mutex_unlock(&rq_mutex);
+        return;
+    }
+
+    idle_waiting &= ~bit;
+    dispatch_idle(cpu_id);
 }
 
 
@@ -210,11 +1710,13 @@ extern void idle(unsigned int cpu_id)
  */
 extern void preempt(unsigned int cpu_id)
 {
-    pthread_mutex_lock(&current_mutex);
+    PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
     pcb_t* pcb_preempt = current[cpu_id];
     pcb_preempt->state = PROCESS_READY;
     pthread_mutex_unlock(&current_mutex);
 
+    end_slice(pcb_preempt, 0);
+
     push(pcb_preempt);
     schedule(cpu_id);
 }
@@ -230,12 +1732,15 @@ extern void preempt(unsigned int cpu_id)
 extern void yield(unsigned int cpu_id)
 {
 
-    pthread_mutex_lock(&current_mutex);
+    PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
     pcb_t *yield;
     yield = current[cpu_id];
 
     yield->state = PROCESS_WAITING;
     pthread_mutex_unlock(&current_mutex);
+
+    end_slice(yield, 1);
+    job_done(yield);
     schedule(cpu_id);
 }
 
@@ -247,12 +1752,18 @@ extern void yield(unsigned int cpu_id)
  */
 extern void terminate(unsigned int cpu_id)
 {
-    pthread_mutex_lock(&current_mutex);
+    PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
     pcb_t* terminate;
     terminate = current[cpu_id];
 
     terminate->state = PROCESS_TERMINATED;
     pthread_mutex_unlock(&current_mutex);
+
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    sched.on_yield(terminate, get_simulator_time() - terminate->dispatch_time);
+    pthread_mutex_unlock(&rq_mutex);
+
+    job_done(terminate);
     schedule(cpu_id);
 }
 
@@ -275,39 +1786,503 @@ extern void terminate(unsigned int cpu_id)
 
 extern void wake_up(pcb_t *process)
 {
-
-    unsigned int best = 10, rpcb = 0, count = 0;
+    int victim;
 
     process->state = PROCESS_READY;
-    push(process);
 
-    if (prior == 1)
-    { pthread_mutex_lock(&current_mutex);
+    /* A job is released each time the process becomes ready */
+    if (process->deadline != 0)
+    {
+        process->abs_deadline = get_simulator_time() + process->deadline;
+    }
 
-        for (unsigned int i = 0; i < count; i++)
+    if (edf == 1 && process->deadline != 0)
+    {
+        unsigned int latest = 0;
+
+        victim = -1;
+        push(process);
+
+        /*
+         * Preempt best-effort work if any is running, else the job with the
+         * latest deadline if that is later than this one.  Not if a CPU is
+         * idle: it will pick the job up.
+         */
+        PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
+        for (unsigned int i = 0; i < cpu_count; i++)
         {
-            if (current[i]==NULL)
+            if (current[i] == NULL)
             {
-                count = 1;
+                victim = -1;
                 break;
-
             }
-            if (current[i]->priority < best)
+            if (current[i]->deadline == 0)
+            {
+                if (latest != ~0u)
+                {
+                    latest = ~0u;
+                    victim = (int)i;
+                }
+            }
+            else if (current[i]->abs_deadline > latest &&
+                     current[i]->abs_deadline > process->abs_deadline)
             {
-              best = current[i]->priority;
-              rpcb = i;
+                latest = current[i]->abs_deadline;
+                victim = (int)i;
             }
         }
         pthread_mutex_unlock(&current_mutex);
 
-        if (count !=1 && best<process->priority )
+        if (victim >= 0)
         {
-           force_preempt(rpcb);
+            force_preempt((unsigned int)victim);
+        }
+        return;
+    }
+
+    push(process);
+
+    /* Let the policy pick a CPU to preempt in favour of the process */
+    PROFILE_LOCK(&current_mutex, PROFILE_CURRENT_MUTEX);
+    victim = sched.on_wake(process);
+    pthread_mutex_unlock(&current_mutex);
+
+    if (victim >= 0)
+    {
+        force_preempt((unsigned int)victim);
+    }
+}
+
+
+
+/*
+ * print_scheduler_stats() is called by the simulator after its own final
+ * statistics, to report anything particular to the scheduling policy.
+ */
+extern void print_scheduler_stats(void)
+{
+    if (adaptive == 1) {
+        printf("Bursts finished within one slice: %u of %u\n",
+            bursts_one_slice, bursts_total);
+    }
+    if (jobs_done > 0) {
+        printf("Deadline misses: %u of %u jobs\n", jobs_missed, jobs_done);
+        printf("Lateness: mean %.2f ticks, max %u ticks\n",
+            (double)total_lateness / jobs_done, max_lateness);
+        printf("Lateness distribution (ticks: jobs):");
+        printf(" on time: %u", lateness_hist[0]);
+        for (unsigned int b = 1; b < LATENESS_BUCKETS; b++) {
+            if (b == LATENESS_BUCKETS - 1) {
+                printf(", %u+: %u", 1u << (b - 1), lateness_hist[b]);
+            } else if (b == 1) {
+                printf(", 1: %u", lateness_hist[b]);
+            } else {
+                printf(", %u-%u: %u", 1u << (b - 1), (1u << b) - 1,
+                    lateness_hist[b]);
+            }
+        }
+        printf("\n");
+    }
+    sched.print_stats();
+    if (wakes_spinning + wakes_parked > 0) {
+        printf("Idle wake-ups: %u while spinning, %u parked\n",
+            wakes_spinning, wakes_parked);
+        printf("Idle to run latency: mean %.1f us spinning, %.1f us "
+            "parked, max %.1f us\n",
+            wakes_spinning ? latency_spinning / 1e3 / wakes_spinning : 0.0,
+            wakes_parked ? latency_parked / 1e3 / wakes_parked : 0.0,
+            max_latency / 1e3);
+        printf("Idle spin burn: %.1f ms of %.1f ms idle host time "
+            "(%.1f%%)\n", spin_burn / 1e6, idle_host_time / 1e6,
+            idle_host_time ? 100.0 * spin_burn / idle_host_time : 0.0);
+    }
+    if (batches > 0) {
+        printf("Idle CPUs dispatched in batches: %u batches, %u CPUs "
+            "dispatched by another\n", batches, batched_cpus);
+    }
+}
+
+
+/*
+ * Checkpoints.  The simulator saves and restores its own state, and asks
+ * the scheduler for the rest: the statistics so far, what each CPU runs,
+ * and the ready queues.  The queues are written twice: as one list of
+ * pids in the order they would be dispatched, which any policy can take
+ * up, and exactly, keys and all, for the built-in policy that wrote them.
+ * A run restored under the same policy (and -d and -e) so carries on just
+ * as the checkpointed run did; under any other it requeues the list.
+ *
+ * Both are called by the simulator between ticks of a deterministic run,
+ * when no handler runs, and take no locks.  Policy modules keep their
+ * queues to themselves, so they can be restored into but not saved.
+ */
+static const sched_ops_t *const builtin_policies[] = {
+    &fifo_ops, &priority_ops, &srtf_ops, &fair_ops, &numa_ops, &capacity_ops,
+    &pack_ops, &gang_ops
+};
+
+#define BUILTIN_POLICIES \
+    (sizeof(builtin_policies) / sizeof(builtin_policies[0]))
+
+static int compare_entries(const void *a, const void *b)
+{
+    const heap_entry_t *x = a, *y = b;
+
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/*
+ * sorted_entries() returns a copy of the entries of heap in the order they
+ * would be popped, to be freed by the caller.
+ */
+static heap_entry_t *sorted_entries(const heap_t *heap)
+{
+    heap_entry_t *entries = malloc(sizeof(heap_entry_t) * (heap->size + 1));
+
+    assert(entries != NULL);
+    if (heap->size > 0) {
+        memcpy(entries, heap->entries, sizeof(heap_entry_t) * heap->size);
+        qsort(entries, heap->size, sizeof(heap_entry_t), compare_entries);
+    }
+    return entries;
+}
+
+/*
+ * save_heap() writes the entries of heap in the order they would be
+ * popped, each as its key and the pid of its process, or the prefix of its
+ * group for group_heap.  restore_heap() pushes them back in that order, so
+ * entries with equal keys keep their order too.
+ */
+static void save_heap(FILE *f, const heap_t *heap, int of_groups)
+{
+    heap_entry_t *entries = sorted_entries(heap);
+    unsigned int id;
+
+    CHECKPOINT_SAVE(f, heap->size);
+    for (unsigned int n = 0; n < heap->size; n++) {
+        id = of_groups ?
+            (unsigned char)((const group_t *)entries[n].item)->prefix :
+            ((const pcb_t *)entries[n].item)->pid;
+        CHECKPOINT_SAVE(f, entries[n].key);
+        CHECKPOINT_SAVE(f, id);
+    }
+    free(entries);
+}
+
+static int restore_heap(FILE *f, heap_t *heap, int of_groups)
+{
+    unsigned int count, id;
+    double key;
+
+    if (!CHECKPOINT_LOAD(f, count)) {
+        return -1;
+    }
+    for (unsigned int n = 0; n < count; n++) {
+        if (!CHECKPOINT_LOAD(f, key) || !CHECKPOINT_LOAD(f, id) ||
+            (of_groups ? id > UCHAR_MAX : id >= pid_count())) {
+            return -1;
+        }
+        if (of_groups) {
+            heap_push(heap, key, group_of((char)id));
+        } else {
+            heap_push(heap, key, pcb_of(id));
+        }
+    }
+    return 0;
+}
+
+static void list_pid(unsigned int **pids, unsigned int *count,
+                     unsigned int pid)
+{
+    if (*count % 64 == 0) {
+        *pids = realloc(*pids, sizeof(unsigned int) * (*count + 64));
+        assert(*pids != NULL);
+    }
+    (*pids)[(*count)++] = pid;
+}
+
+static void list_heap(unsigned int **pids, unsigned int *count,
+                      const heap_t *heap)
+{
+    heap_entry_t *entries = sorted_entries(heap);
+
+    for (unsigned int n = 0; n < heap->size; n++) {
+        list_pid(pids, count, ((const pcb_t *)entries[n].item)->pid);
+    }
+    free(entries);
+}
+
+/*
+ * policy_queues() returns the FIFO queues of the NUMA, capacity-aware,
+ * consolidation and gang policies, and their number in count; NULL under
+ * any other policy.
+ */
+static pid_queue_t *policy_queues(unsigned int *count)
+{
+    if (sched_table == &numa_ops) {
+        *count = nodes;
+        return node_queues;
+    }
+    if (sched_table == &capacity_ops) {
+        *count = 2;
+        return class_queues;
+    }
+    if (sched_table == &pack_ops) {
+        *count = 1;
+        return &pack_queue;
+    }
+    if (sched_table == &gang_ops) {
+        *count = 1;
+        return &gang_queue;
+    }
+    *count = 0;
+    return NULL;
+}
+
+/*
+ * ready_order() lists the ready processes in the order they would be
+ * dispatched, as far as that is known: deadline jobs first, then the
+ * policy's queue, for fair share group by group.
+ */
+static unsigned int *ready_order(unsigned int *count)
+{
+    unsigned int *pids = NULL, queue_count;
+    pid_queue_t *queues = policy_queues(&queue_count);
+
+    *count = 0;
+    list_heap(&pids, count, &edf_heap);
+    if (sched_table == &fifo_ops) {
+        for (unsigned int pid = head; pid != PID_NONE;
+             pid = pcb_of(pid)->next) {
+            list_pid(&pids, count, pid);
         }
+    } else if (queues != NULL) {
+        for (unsigned int q = 0; q < queue_count; q++) {
+            for (unsigned int pid = queues[q].head; pid != PID_NONE;
+                 pid = pcb_of(pid)->next) {
+                list_pid(&pids, count, pid);
+            }
+        }
+    } else if (sched_table == &fair_ops) {
+        heap_entry_t *entries = sorted_entries(&group_heap);
+
+        for (unsigned int n = 0; n < group_heap.size; n++) {
+            list_heap(&pids, count,
+                &((const group_t *)entries[n].item)->procs);
+        }
+        free(entries);
+    } else {
+        list_heap(&pids, count, &rq_heap);
+    }
+    return pids;
+}
+
+extern int save_scheduler(FILE *f)
+{
+    unsigned int policy, count, pid, *ready, queue_count;
+    pid_queue_t *queues = policy_queues(&queue_count);
+
+    for (policy = 0; policy < BUILTIN_POLICIES &&
+         builtin_policies[policy] != sched_table; policy++) {
+    }
+    if (policy == BUILTIN_POLICIES) {
+        fprintf(stderr, "Policy %s cannot be checkpointed\n", sched.name);
+        return -1;
     }
 
+    CHECKPOINT_SAVE(f, policy);
+    CHECKPOINT_SAVE(f, edf);
+    CHECKPOINT_SAVE(f, predictive);
+    CHECKPOINT_SAVE(f, bursts_total);
+    CHECKPOINT_SAVE(f, bursts_one_slice);
+    CHECKPOINT_SAVE(f, prediction_error);
+    CHECKPOINT_SAVE(f, predictions);
+    CHECKPOINT_SAVE(f, jobs_done);
+    CHECKPOINT_SAVE(f, jobs_missed);
+    CHECKPOINT_SAVE(f, max_lateness);
+    CHECKPOINT_SAVE(f, total_lateness);
+    CHECKPOINT_SAVE(f, lateness_hist);
+    CHECKPOINT_SAVE(f, max_wait);
+    CHECKPOINT_SAVE(f, priority_boosts);
+
+    for (unsigned int cpu = 0; cpu < cpu_count; cpu++) {
+        pid = current[cpu] != NULL ? current[cpu]->pid : PID_NONE;
+        CHECKPOINT_SAVE(f, pid);
+        CHECKPOINT_SAVE(f, cpu_dispatches[cpu]);
+    }
+
+    ready = ready_order(&count);
+    CHECKPOINT_SAVE(f, count);
+    CHECKPOINT_SAVE_ARRAY(f, ready, count);
+    free(ready);
+
+    /*
+     * The FIFO queue is the rest of the list, and so are the NUMA,
+     * capacity, consolidation and gang queues, given their lengths; the
+     * heaps need their keys.
+     */
+    save_heap(f, &edf_heap, 0);
+    if (queues != NULL) {
+        CHECKPOINT_SAVE(f, queue_count);
+        for (unsigned int q = 0; q < queue_count; q++) {
+            CHECKPOINT_SAVE(f, queues[q].length);
+        }
+        CHECKPOINT_SAVE(f, node_local);
+        CHECKPOINT_SAVE(f, node_steals);
+        CHECKPOINT_SAVE(f, placed);
+        CHECKPOINT_SAVE(f, capacity_preemptions);
+        CHECKPOINT_SAVE(f, active_cpus);
+        CHECKPOINT_SAVE(f, unparks);
+        CHECKPOINT_SAVE(f, parks);
+        CHECKPOINT_SAVE(f, gang_dispatches);
+        CHECKPOINT_SAVE(f, gang_joins);
+        CHECKPOINT_SAVE(f, gang_preemptions);
+    } else if (sched_table == &priority_ops || sched_table == &srtf_ops) {
+        save_heap(f, &rq_heap, 0);
+    } else if (sched_table == &fair_ops) {
+        count = 0;
+        for (unsigned int g = 0; g <= UCHAR_MAX; g++) {
+            count += groups[g] != NULL;
+        }
+        CHECKPOINT_SAVE(f, min_group_vruntime);
+        CHECKPOINT_SAVE(f, count);
+        for (unsigned int g = 0; g <= UCHAR_MAX; g++) {
+            if (groups[g] != NULL) {
+                CHECKPOINT_SAVE(f, g);
+                CHECKPOINT_SAVE(f, groups[g]->vruntime);
+                CHECKPOINT_SAVE(f, groups[g]->min_vruntime);
+                CHECKPOINT_SAVE(f, groups[g]->cpu_time);
+                CHECKPOINT_SAVE(f, groups[g]->queued);
+                save_heap(f, &groups[g]->procs, 0);
+            }
+        }
+        save_heap(f, &group_heap, 1);
+    }
+    return ferror(f) ? -1 : 0;
 }
 
+extern int restore_scheduler(FILE *f)
+{
+    unsigned int policy, count, pid, g, *ready = NULL, queue_count;
+    pid_queue_t *queues = policy_queues(&queue_count);
+    int saved_edf, saved_predictive, ok;
+    pcb_t *process;
+    group_t *group;
+
+    ok = CHECKPOINT_LOAD(f, policy) && policy < BUILTIN_POLICIES &&
+        CHECKPOINT_LOAD(f, saved_edf) &&
+        CHECKPOINT_LOAD(f, saved_predictive) &&
+        CHECKPOINT_LOAD(f, bursts_total) &&
+        CHECKPOINT_LOAD(f, bursts_one_slice) &&
+        CHECKPOINT_LOAD(f, prediction_error) &&
+        CHECKPOINT_LOAD(f, predictions) &&
+        CHECKPOINT_LOAD(f, jobs_done) &&
+        CHECKPOINT_LOAD(f, jobs_missed) &&
+        CHECKPOINT_LOAD(f, max_lateness) &&
+        CHECKPOINT_LOAD(f, total_lateness) &&
+        CHECKPOINT_LOAD(f, lateness_hist) &&
+        CHECKPOINT_LOAD(f, max_wait) &&
+        CHECKPOINT_LOAD(f, priority_boosts);
+
+    for (unsigned int cpu = 0; ok && cpu < cpu_count; cpu++) {
+        ok = CHECKPOINT_LOAD(f, pid) &&
+            (pid == PID_NONE || pid < pid_count()) &&
+            CHECKPOINT_LOAD(f, cpu_dispatches[cpu]);
+        process = (ok && pid != PID_NONE) ? pcb_of(pid) : NULL;
+        track_running(cpu, process);
+        current[cpu] = process;
+    }
+
+    ok = ok && CHECKPOINT_LOAD(f, count) && count <= pid_count();
+    if (ok) {
+        ready = malloc(sizeof(unsigned int) * (count + 1));
+        assert(ready != NULL);
+        ok = CHECKPOINT_LOAD_ARRAY(f, ready, count);
+    }
+    for (unsigned int n = 0; ok && n < count; n++) {
+        ok = ready[n] < pid_count();
+    }
+    if (!ok) {
+        free(ready);
+        return -1;
+    }
+
+    /* Another policy takes the processes as they come */
+    if (builtin_policies[policy] != sched_table || saved_edf != edf ||
+        saved_predictive != predictive) {
+        if (sched_table == &pack_ops) {
+            for (unsigned int cpu = 0; cpu < cpu_count; cpu++) {
+                if (current[cpu] != NULL && cpu >= active_cpus) {
+                    pack_set_active(cpu + 1);
+                }
+            }
+        }
+        for (unsigned int n = 0; n < count; n++) {
+            queue_ready(pcb_of(ready[n]));
+        }
+        free(ready);
+        publish_ready();
+        return 0;
+    }
+
+    ok = restore_heap(f, &edf_heap, 0) == 0;
+    if (sched_table == &fifo_ops) {
+        for (unsigned int n = edf_heap.size; ok && n < count; n++) {
+            fifo_enqueue(pcb_of(ready[n]));
+        }
+    } else if (queues != NULL) {
+        unsigned int saved_count, length, n = edf_heap.size;
+
+        ok = ok && CHECKPOINT_LOAD(f, saved_count) &&
+            saved_count == queue_count;
+        for (unsigned int q = 0; ok && q < queue_count; q++) {
+            ok = CHECKPOINT_LOAD(f, length) && length <= count - n;
+            for (unsigned int k = 0; ok && k < length; k++) {
+                queue_append(&queues[q], pcb_of(ready[n++]));
+            }
+        }
+        ok = ok && CHECKPOINT_LOAD(f, node_local) &&
+            CHECKPOINT_LOAD(f, node_steals) &&
+            CHECKPOINT_LOAD(f, placed) &&
+            CHECKPOINT_LOAD(f, capacity_preemptions) &&
+            CHECKPOINT_LOAD(f, active_cpus) &&
+            CHECKPOINT_LOAD(f, unparks) &&
+            CHECKPOINT_LOAD(f, parks) &&
+            CHECKPOINT_LOAD(f, gang_dispatches) &&
+            CHECKPOINT_LOAD(f, gang_joins) &&
+            CHECKPOINT_LOAD(f, gang_preemptions);
+        if (ok && sched_table == &pack_ops) {
+            ok = active_cpus >= 1 && active_cpus <= cpu_count;
+            if (ok) {
+                pack_set_active(active_cpus);
+            }
+        }
+    } else if (sched_table == &fair_ops) {
+        ok = ok && CHECKPOINT_LOAD(f, min_group_vruntime) &&
+            CHECKPOINT_LOAD(f, count);
+        for (unsigned int n = 0; ok && n < count; n++) {
+            ok = CHECKPOINT_LOAD(f, g) && g <= UCHAR_MAX;
+            if (!ok) {
+                break;
+            }
+            group = group_of((char)g);
+            ok = CHECKPOINT_LOAD(f, group->vruntime) &&
+                CHECKPOINT_LOAD(f, group->min_vruntime) &&
+                CHECKPOINT_LOAD(f, group->cpu_time) &&
+                CHECKPOINT_LOAD(f, group->queued) &&
+                restore_heap(f, &group->procs, 0) == 0;
+        }
+        ok = ok && restore_heap(f, &group_heap, 1) == 0;
+    } else {
+        ok = ok && restore_heap(f, &rq_heap, 0) == 0;
+    }
+    free(ready);
+    publish_ready();
+    return ok ? 0 : -1;
+}
 
 
 /*
@@ -316,19 +2291,27 @@ extern void wake_up(pcb_t *process)
  */
 int main(int argc, char *argv[])
 {
-
-    strf_true = 0;
-    round_robin = 0;
-    prior = 0;
+    int n;
+    unsigned int switch_cost = 0, migration_cost = 0, idle_cost = 0;
+    unsigned int max_arrivals = 0, horizon = 0;
+    const char *arrivals = NULL;
+    const sched_ops_t *chosen = &fifo_ops;
+    char *policy_args = NULL;
+    int numa = 0;
+
+    affinity = 0;
+    adaptive = 0;
+    predictive = 0;
+    edf = 0;
+    inherit = 0;
+    burst_alpha = 0.5f;
+    aging_ticks = PRIORITY_AGING;
+    spin_limit = SPIN_LIMIT;
     TimeSlice = -1;
 
-    if (argc > 4|| argc < 2)
+    if (argc < 2)
     {
-        fprintf(stderr, "CS 2200 Project 4 -- Multithreaded OS Simulator\n"
-            "Usage: ./os-sim <# CPUs> [ -r <time slice> | -p ]\n"
-            "    Default : FIFO Scheduler\n"
-            "         -r : Round-Robin Scheduler\n"
-            "         -p : Priority Scheduler\n\n");
+        help();
         return -1;
     }
 
@@ -340,32 +2323,318 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    if (argc > 2) {
+    /* Policies set up per-CPU state in init(), before the simulator runs */
+    if (cpu_count > 16)
+    {
+        fprintf(stderr, "CPU Count must be an integer from 1 to 16!\n\n");
+        return -1;
+    }
+
+    for (n = 2; n < argc; n++) {
+
+        if (strcmp(argv[n], "-p") == 0)
+        {
+             chosen = &priority_ops;
+        }
+        else if (strcmp(argv[n], "-w") == 0 && n + 1 < argc)
+        {
+            aging_ticks = strtoul(argv[++n], NULL, 0);
+        }
+        else if (strcmp(argv[n], "-R") == 0 && n + 1 < argc)
+        {
+            char *end;
+
+            adaptive = 1;
+            slice_min = strtoul(argv[++n], &end, 0);
+            slice_max = (*end == ':') ? strtoul(end + 1, NULL, 0) : 0;
+            if (slice_min == 0 || slice_max < slice_min)
+            {
+                help();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[n], "-s") == 0)
+        {
+            chosen = &srtf_ops;
+        }
+        else if (strcmp(argv[n], "-e") == 0 && n + 1 < argc)
+        {
+            chosen = &srtf_ops;
+            predictive = 1;
+            burst_alpha = strtof(argv[++n], NULL);
+            if (burst_alpha <= 0.0f || burst_alpha > 1.0f)
+            {
+                help();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[n], "-f") == 0 && n + 1 < argc)
+        {
+            char *item = argv[++n], *end;
+
+            /* Group weights, e.g. I=3,C=1 */
+            chosen = &fair_ops;
+            while (*item != '\0')
+            {
+                unsigned long weight;
+
+                if (item[1] != '=')
+                {
+                    help();
+                    return -1;
+                }
+                weight = strtoul(item + 2, &end, 0);
+                if (end == item + 2 || weight == 0 ||
+                    (*end != ',' && *end != '\0'))
+                {
+                    help();
+                    return -1;
+                }
+                group_of(item[0])->weight = (unsigned int)weight;
+                item = (*end == ',') ? end + 1 : end;
+            }
+        }
+        else if (strcmp(argv[n], "-d") == 0)
+        {
+            edf = 1;
+        }
+        else if (strcmp(argv[n], "-a") == 0)
+        {
+            affinity = 1;
+        }
+        else if (strcmp(argv[n], "-r") == 0 && n + 1 < argc)
+        {
+            TimeSlice = strtoul(argv[++n], NULL, 0);
+        }
+        else if (strcmp(argv[n], "-P") == 0 && n + 1 < argc)
+        {
+            /* A policy module, and what to pass its init() */
+            char *path = argv[++n];
+
+            policy_args = strchr(path, ':');
+            if (policy_args != NULL)
+            {
+                *policy_args++ = '\0';
+            }
+            chosen = load_policy(path);
+            if (chosen == NULL)
+            {
+                return -1;
+            }
+        }
+        else if (strcmp(argv[n], "-S") == 0 && n + 1 < argc)
+        {
+            set_workload_seed(strtoul(argv[++n], NULL, 0));
+        }
+        else if (strcmp(argv[n], "-D") == 0)
+        {
+            set_deterministic(1);
+        }
+        else if (strcmp(argv[n], "-C") == 0 && n + 1 < argc)
+        {
+            /* <tick>:<file> */
+            char *end;
+            unsigned long tick = strtoul(argv[++n], &end, 0);
+
+            if (end == argv[n] || *end != ':' || end[1] == '\0')
+            {
+                help();
+                return -1;
+            }
+            set_checkpoint((unsigned int)tick, end + 1);
+        }
+        else if (strcmp(argv[n], "-L") == 0 && n + 1 < argc)
+        {
+            set_restore(argv[++n]);
+        }
+        else if (strcmp(argv[n], "-N") == 0 && n + 1 < argc)
+        {
+            /* <sockets>x<cores>x<threads>[:<remote penalty %>] */
+            unsigned int sockets, cores, threads, penalty = 50;
+            int fields = sscanf(argv[++n], "%ux%ux%u:%u", &sockets, &cores,
+                &threads, &penalty);
+
+            if (fields < 3 || sockets == 0 || cores == 0 || threads == 0)
+            {
+                help();
+                return -1;
+            }
+            numa = sockets > 1;
+            set_topology(sockets, cores, threads, penalty);
+        }
+        else if (strcmp(argv[n], "-H") == 0 && n + 1 < argc)
+        {
+            char *item = argv[++n], *end;
+            unsigned long percent = 0;
 
-        if (strcmp(argv[2], "-p") == 0)
+            for (unsigned int cpu = 0; cpu < cpu_count && cpu < 16; cpu++)
+            {
+                if (*item != '\0')
+                {
+                    percent = strtoul(item, &end, 0);
+                    if (end == item || percent == 0 ||
+                        (*end != ',' && *end != '\0'))
+                    {
+                        help();
+                        return -1;
+                    }
+                    item = (*end == ',') ? end + 1 : end;
+                }
+                set_cpu_capacity(cpu, (unsigned int)percent);
+            }
+        }
+        else if (strcmp(argv[n], "-E") == 0 && n + 1 < argc)
         {
-             prior = 1;
+            /* <deep after>[:<deep exit>[:<shallow exit>]] */
+            unsigned int deep_after, deep_exit = 2, shallow_exit = 0;
+
+            if (sscanf(argv[++n], "%u:%u:%u", &deep_after, &deep_exit,
+                &shallow_exit) < 1)
+            {
+                help();
+                return -1;
+            }
+            set_power_states(deep_after, shallow_exit, deep_exit);
         }
+        else if (strcmp(argv[n], "-F") == 0 && n + 1 < argc)
+        {
+            char *item = argv[++n], *end;
+            unsigned long percent = 0;
 
-        if (strcmp(argv[2],"-r") == 0)
+            for (unsigned int cpu = 0; cpu < cpu_count && cpu < 16; cpu++)
+            {
+                if (*item != '\0')
+                {
+                    percent = strtoul(item, &end, 0);
+                    if (end == item || percent == 0 || percent > 100 ||
+                        (*end != ',' && *end != '\0'))
+                    {
+                        help();
+                        return -1;
+                    }
+                    item = (*end == ',') ? end + 1 : end;
+                }
+                set_cpu_frequency(cpu, (unsigned int)percent);
+            }
+        }
+        else if (strcmp(argv[n], "-g") == 0 && n + 1 < argc)
         {
-            round_robin = 1;
+            chosen = &pack_ops;
+            pack_wait = strtoul(argv[++n], NULL, 0);
         }
+        else if (strcmp(argv[n], "-t") == 0)
+        {
+            set_threaded_workload(1);
+        }
+        else if (strcmp(argv[n], "-G") == 0)
+        {
+            chosen = &gang_ops;
+        }
+        else if (strcmp(argv[n], "-I") == 0)
+        {
+            inherit = 1;
+        }
+        else if (strcmp(argv[n], "-k") == 0 && n + 1 < argc)
+        {
+            char *end;
 
-        if (argc > 3)
+            chosen = &capacity_ops;
+            long_burst = strtoul(argv[++n], &end, 0);
+            imbalance = (*end == ':') ? strtoul(end + 1, NULL, 0) : 1;
+            if (long_burst == 0 || imbalance == 0)
+            {
+                help();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[n], "-M") == 0 && n + 1 < argc)
+        {
+            set_metrics(argv[++n]);
+        }
+        else if (strcmp(argv[n], "-A") == 0 && n + 1 < argc)
+        {
+            arrivals = argv[++n];
+        }
+        else if (strcmp(argv[n], "-n") == 0 && n + 1 < argc)
+        {
+            max_arrivals = strtoul(argv[++n], NULL, 0);
+        }
+        else if (strcmp(argv[n], "-T") == 0 && n + 1 < argc)
+        {
+            horizon = strtoul(argv[++n], NULL, 0);
+        }
+        else if (strcmp(argv[n], "-c") == 0 && n + 1 < argc)
+        {
+            switch_cost = strtoul(argv[++n], NULL, 0);
+        }
+        else if (strcmp(argv[n], "-m") == 0 && n + 1 < argc)
+        {
+            migration_cost = strtoul(argv[++n], NULL, 0);
+        }
+        else if (strcmp(argv[n], "-i") == 0 && n + 1 < argc)
+        {
+            idle_cost = strtoul(argv[++n], NULL, 0);
+        }
+        else if (strcmp(argv[n], "-b") == 0 && n + 1 < argc)
         {
-            TimeSlice = strtoul(argv[3], NULL, 0);
+            spin_limit = strtoull(argv[++n], NULL, 0) * 1000ull;
         }
+        else
+        {
+            help();
+            return -1;
+        }
+    }
+
+    if (numa && chosen == &fifo_ops)
+    {
+        chosen = &numa_ops;
+    }
+    if (affinity && chosen != &fifo_ops)
+    {
+        fprintf(stderr, "Affinity scheduling (-a) needs the FIFO or "
+            "round-robin scheduler!\n\n");
+        return -1;
+    }
+    use_policy(chosen);
+    if (sched.init != NULL && sched.init(cpu_count, policy_args) != 0)
+    {
+        fprintf(stderr, "Policy %s failed to start\n", sched.name);
+        return -1;
+    }
 
+    set_switch_costs(switch_cost, migration_cost, idle_cost);
+    if (arrivals != NULL &&
+        set_arrival_model(arrivals, max_arrivals, horizon) != 0)
+    {
+        help();
+        return -1;
     }
 
     /* Allocate the current[] array and its mutex */
-    current = malloc(sizeof(pcb_t*) * cpu_count);
+    current = calloc(cpu_count, sizeof(pcb_t*));
     assert(current != NULL);
     pthread_mutex_init(&current_mutex, NULL);
+    idle_cpus = (cpu_count < 32) ? (1u << cpu_count) - 1 : ~0u;
+
+    cpu_dispatches = calloc(cpu_count, sizeof(unsigned int));
+    assert(cpu_dispatches != NULL);
+
+    /* Idle CPUs start out expecting work within a quarter of the limit */
+    spin_budget = malloc(sizeof(unsigned long long) * cpu_count);
+    assert(spin_budget != NULL);
+    wake_gap = malloc(sizeof(double) * cpu_count);
+    assert(wake_gap != NULL);
+    for (unsigned int cpu = 0; cpu < cpu_count; cpu++) {
+        wake_gap[cpu] = (double)spin_limit / 4.0;
+        spin_budget[cpu] = spin_limit / 2;
+    }
 
     pthread_mutex_init(&rq_mutex, NULL);
-    head = NULL;
+    head = tail = PID_NONE;
+    heap_init(&rq_heap);
+    heap_init(&edf_heap);
+    heap_init(&group_heap);
     pthread_cond_init(&no_idle, NULL);
 
     start_simulator(cpu_count);
@@ -1,4 +1,3 @@
-
 /*
  * student.h
  * Multithreaded OS Simulation for CS 2200
@@ -9,6 +8,8 @@
 
 #pragma once
 
+#include <stdio.h>
+
 #include "os-sim.h"
 
 /* Function declarations */
@@ -17,3 +18,6 @@ extern void preempt(unsigned int cpu_id);
 extern void yield(unsigned int cpu_id);
 extern void terminate(unsigned int cpu_id);
 extern void wake_up(pcb_t *process);
+extern void print_scheduler_stats(void);
+extern int save_scheduler(FILE *f);
+extern int restore_scheduler(FILE *f);
@@ -0,0 +1,173 @@
+/*
+ * timer-wheel.c
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * A hierarchical timing wheel.  See timer-wheel.h.
+ */
+
+#include <stddef.h>
+
+#include "timer-wheel.h"
+
+
+static void list_init(wheel_timer_t *head);
+static void list_append(wheel_timer_t *head, wheel_timer_t *timer);
+static void cascade(timer_wheel_t *wheel, wheel_timer_t *head);
+
+
+/* Each slot is a circular doubly-linked list with a sentinel head */
+static void list_init(wheel_timer_t *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_append(wheel_timer_t *head, wheel_timer_t *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/* Re-files every timer of a slot now that the wheel has come closer */
+static void cascade(timer_wheel_t *wheel, wheel_timer_t *head)
+{
+    wheel_timer_t *timer = head->next, *next;
+
+    list_init(head);
+    while (timer != head)
+    {
+        next = timer->next;
+        timer->pending = 0;
+        wheel_add(wheel, timer, timer->expires);
+        timer = next;
+    }
+}
+
+extern void wheel_init(timer_wheel_t *wheel, unsigned int now)
+{
+    unsigned int level, slot;
+
+    wheel->now = now;
+    for (level=0; level<WHEEL_LEVELS; level++)
+    {
+        for (slot=0; slot<WHEEL_SLOTS; slot++)
+            list_init(&wheel->slots[level][slot]);
+    }
+    list_init(&wheel->overflow);
+}
+
+extern void wheel_add(timer_wheel_t *wheel, wheel_timer_t *timer,
+                      unsigned int expires)
+{
+    unsigned int delta, level;
+
+    wheel_cancel(timer);
+
+    if (expires < wheel->now)
+        expires = wheel->now;
+    timer->expires = expires;
+    timer->pending = 1;
+
+    /*
+     * File the timer at the lowest level whose span covers it.  Level l
+     * indexes by bits [l * WHEEL_BITS, (l + 1) * WHEEL_BITS) of the expiry.
+     */
+    delta = expires - wheel->now;
+    for (level=0; level<WHEEL_LEVELS; level++)
+    {
+        if (delta < (1u << (WHEEL_BITS * (level + 1))))
+        {
+            list_append(&wheel->slots[level][(expires >> (WHEEL_BITS * level))
+                & (WHEEL_SLOTS - 1)], timer);
+            return;
+        }
+    }
+    list_append(&wheel->overflow, timer);
+}
+
+extern void wheel_cancel(wheel_timer_t *timer)
+{
+    if (!timer->pending)
+        return;
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->pending = 0;
+}
+
+extern wheel_timer_t *wheel_expire(timer_wheel_t *wheel)
+{
+    wheel_timer_t *head = &wheel->slots[0][wheel->now & (WHEEL_SLOTS - 1)];
+    wheel_timer_t *timer, *expired = NULL, **tail = &expired;
+
+    /* Every timer in the current level 0 slot expires now */
+    while ((timer = head->next) != head)
+    {
+        wheel_cancel(timer);
+        timer->next = NULL;
+        *tail = timer;
+        tail = &timer->next;
+    }
+
+    return expired;
+}
+
+extern void wheel_advance(timer_wheel_t *wheel)
+{
+    unsigned int level, now;
+
+    now = ++wheel->now;
+
+    /*
+     * Whenever the low bits wrap, the next slot of the level above is
+     * brought down, highest level first.
+     */
+    if ((now & ((1u << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0)
+        cascade(wheel, &wheel->overflow);
+    for (level=WHEEL_LEVELS-1; level>0; level--)
+    {
+        if ((now & ((1u << (WHEEL_BITS * level)) - 1)) == 0)
+            cascade(wheel, &wheel->slots[level][(now >> (WHEEL_BITS * level))
+                & (WHEEL_SLOTS - 1)]);
+    }
+}
+
+extern unsigned int wheel_next(const timer_wheel_t *wheel)
+{
+    const wheel_timer_t *head, *timer;
+    unsigned int level, slot, earliest = ~0u;
+
+    /*
+     * The first non-empty level 0 slot (in time order) holds the answer if
+     * there is one; otherwise the higher levels have to be searched.
+     */
+    for (slot=0; slot<WHEEL_SLOTS; slot++)
+    {
+        head = &wheel->slots[0][(wheel->now + slot) & (WHEEL_SLOTS - 1)];
+        if (head->next != head)
+            return head->next->expires;
+    }
+
+    for (level=1; level<WHEEL_LEVELS; level++)
+    {
+        for (slot=0; slot<WHEEL_SLOTS; slot++)
+        {
+            head = &wheel->slots[level][slot];
+            for (timer = head->next; timer != head; timer = timer->next)
+            {
+                if (timer->expires < earliest)
+                    earliest = timer->expires;
+            }
+        }
+    }
+    head = &wheel->overflow;
+    for (timer = head->next; timer != head; timer = timer->next)
+    {
+        if (timer->expires < earliest)
+            earliest = timer->expires;
+    }
+
+    return earliest;
+}
@@ -0,0 +1,65 @@
+/*
+ * timer-wheel.h
+ * Multithreaded OS Simulation for CS 2200
+ *
+ * A hierarchical timing wheel holding the simulator's pending timed events:
+ * time slice expiry, CPU burst completion and I/O completion.
+ */
+
+#pragma once
+
+
+/*
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots.  A slot at level
+ * l covers WHEEL_SLOTS^l ticks; events further out than the top level
+ * reaches wait on an overflow list.  Events migrate ("cascade") to a lower
+ * level when the wheel's time reaches their slot, so each event is touched
+ * at most WHEEL_LEVELS times and a tick in which nothing expires costs
+ * O(1).
+ */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1u << WHEEL_BITS)
+#define WHEEL_LEVELS 3
+
+/*
+ * A timer is embedded in whatever owns the event; owner identifies it to
+ * whoever handles the expiry.
+ */
+typedef struct _wheel_timer_t {
+    unsigned int expires;
+    unsigned int owner;
+    int pending;
+    struct _wheel_timer_t *next;
+    struct _wheel_timer_t *prev;
+} wheel_timer_t;
+
+typedef struct {
+    unsigned int now;
+    wheel_timer_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    wheel_timer_t overflow;
+} timer_wheel_t;
+
+
+/*
+ * None of these functions lock; the caller protects the wheel.
+ *
+ *   wheel_init()    : empties the wheel and sets its time to now
+ *   wheel_add()     : arms timer to expire at tick expires (or at the
+ *                     wheel's current tick, if expires is already past);
+ *                     re-arming a pending timer moves it
+ *   wheel_cancel()  : disarms timer if it is pending, in O(1)
+ *   wheel_expire()  : detaches and returns the list (linked by next) of
+ *                     timers expiring at the wheel's current tick, or NULL.
+ *                     It may be called again in the same tick to pick up
+ *                     timers armed for the current tick since.
+ *   wheel_advance() : moves the wheel to the next tick
+ *   wheel_next()    : returns the earliest pending expiry, so a clock can
+ *                     skip idle ticks; ~0u if nothing is pending
+ */
+extern void wheel_init(timer_wheel_t *wheel, unsigned int now);
+extern void wheel_add(timer_wheel_t *wheel, wheel_timer_t *timer,
+                      unsigned int expires);
+extern void wheel_cancel(wheel_timer_t *timer);
+extern wheel_timer_t *wheel_expire(timer_wheel_t *wheel);
+extern void wheel_advance(timer_wheel_t *wheel);
+extern unsigned int wheel_next(const timer_wheel_t *wheel);
@@ -0,0 +1,399 @@
+/*
+ * bench-queue.c
+ * Microbenchmarks for the CS 2200 OS Simulation
+ *
+ * Ready queue benchmarks.  The scheduler is compiled in here, with its
+ * handlers and the simulator API it calls renamed, so that its queues can
+ * be driven without a simulation: the stub simulator's clock is a plain
+ * counter, and nothing is ever dispatched.
+ *
+ * For each queueing policy and size, the queue is filled to size entries,
+ * then kept there while batches of entries are popped and pushed back.
+ */
+
+#define main student_main
+#define help student_help
+#define idle student_idle
+#define preempt student_preempt
+#define yield student_yield
+#define terminate student_terminate
+#define wake_up student_wake_up
+#define print_scheduler_stats student_print_scheduler_stats
+#define save_scheduler student_save_scheduler
+#define restore_scheduler student_restore_scheduler
+#define start_simulator stub_start_simulator
+#define set_workload_seed stub_set_workload_seed
+#define set_arrival_model stub_set_arrival_model
+#define set_checkpoint stub_set_checkpoint
+#define set_restore stub_set_restore
+#define set_metrics stub_set_metrics
+#define set_topology stub_set_topology
+#define node_count stub_node_count
+#define cpu_node stub_cpu_node
+#define process_node stub_process_node
+#define set_cpu_capacity stub_set_cpu_capacity
+#define cpu_capacity stub_cpu_capacity
+#define set_power_states stub_set_power_states
+#define set_cpu_frequency stub_set_cpu_frequency
+#define set_cpu_parked stub_set_cpu_parked
+#define cpu_parked stub_cpu_parked
+#define set_threaded_workload stub_set_threaded_workload
+#define thread_group stub_thread_group
+#define thread_count stub_thread_count
+#define lock_holder stub_lock_holder
+#define lock_waiters stub_lock_waiters
+#define set_switch_costs stub_set_switch_costs
+#define context_switch stub_context_switch
+#define context_switch_batch stub_context_switch_batch
+#define force_preempt stub_force_preempt
+#define get_simulator_time stub_get_simulator_time
+#define pcb_of stub_pcb_of
+#define pid_count stub_pid_count
+#define process_name stub_process_name
+#define mt_safe_usleep stub_mt_safe_usleep
+
+int main(int argc, char *argv[]);
+
+#include "../src/student.c"
+
+#include "bench.h"
+
+
+#define BATCH 1024
+
+typedef enum {
+    QUEUE_FIFO = 0,
+    QUEUE_PRIORITY,
+    QUEUE_SRTF,
+    QUEUE_EDF,
+    QUEUE_FAIR,
+    QUEUE_POLICIES
+} queue_policy_t;
+
+static const char *queue_names[QUEUE_POLICIES] = {
+    "fifo", "priority", "srtf", "edf", "fair"
+};
+static const char *bench_names[] = {
+    "Iapache", "Ibash", "Imozilla", "Ccpu", "Cgcc", "Cspice", "Cmysql",
+    "Ichrome"
+};
+#define BENCH_NAMES (sizeof(bench_names) / sizeof(bench_names[0]))
+
+static unsigned int stub_time = 0;
+static pcb_t *bench_pcbs;
+
+static void select_policy(queue_policy_t policy);
+static pcb_t *take(void);
+static void fill(pcb_t *pcbs, unsigned long size);
+static void drain(void);
+static void measure(queue_policy_t policy, pcb_t *pcbs, unsigned long size);
+
+
+/* The simulator, as far as the scheduler can tell */
+extern void stub_start_simulator(unsigned int new_cpu_count)
+{
+    (void)new_cpu_count;
+}
+
+extern void stub_set_workload_seed(unsigned int seed)
+{
+    (void)seed;
+}
+
+extern int stub_set_arrival_model(const char *spec,
+                                  unsigned int new_max_arrivals,
+                                  unsigned int new_horizon)
+{
+    (void)spec;
+    (void)new_max_arrivals;
+    (void)new_horizon;
+    return 0;
+}
+
+extern void stub_set_checkpoint(unsigned int tick, const char *path)
+{
+    (void)tick;
+    (void)path;
+}
+
+extern void stub_set_restore(const char *path)
+{
+    (void)path;
+}
+
+extern void stub_set_metrics(const char *name)
+{
+    (void)name;
+}
+
+extern void stub_set_topology(unsigned int sockets, unsigned int cores,
+                              unsigned int threads,
+                              unsigned int remote_penalty)
+{
+    (void)sockets;
+    (void)cores;
+    (void)threads;
+    (void)remote_penalty;
+}
+
+extern unsigned int stub_node_count(void)
+{
+    return 1;
+}
+
+extern unsigned int stub_cpu_node(unsigned int cpu_id)
+{
+    (void)cpu_id;
+    return 0;
+}
+
+extern int stub_process_node(const pcb_t *pcb)
+{
+    (void)pcb;
+    return -1;
+}
+
+extern void stub_set_cpu_capacity(unsigned int cpu_id, unsigned int percent)
+{
+    (void)cpu_id;
+    (void)percent;
+}
+
+extern unsigned int stub_cpu_capacity(unsigned int cpu_id)
+{
+    (void)cpu_id;
+    return 100;
+}
+
+extern void stub_set_power_states(unsigned int deep_after,
+                                  unsigned int shallow_exit,
+                                  unsigned int deep_exit)
+{
+    (void)deep_after;
+    (void)shallow_exit;
+    (void)deep_exit;
+}
+
+extern void stub_set_cpu_frequency(unsigned int cpu_id, unsigned int percent)
+{
+    (void)cpu_id;
+    (void)percent;
+}
+
+extern void stub_set_cpu_parked(unsigned int cpu_id, int park)
+{
+    (void)cpu_id;
+    (void)park;
+}
+
+extern int stub_cpu_parked(unsigned int cpu_id)
+{
+    (void)cpu_id;
+    return 0;
+}
+
+extern void stub_set_threaded_workload(int enable)
+{
+    (void)enable;
+}
+
+extern unsigned int stub_thread_group(const pcb_t *pcb)
+{
+    return pcb->pid;
+}
+
+extern unsigned int stub_thread_count(const pcb_t *pcb)
+{
+    (void)pcb;
+    return 1;
+}
+
+extern unsigned int stub_lock_holder(const pcb_t *pcb)
+{
+    (void)pcb;
+    return PID_NONE;
+}
+
+extern unsigned int stub_lock_waiters(const pcb_t *pcb, unsigned int *lowest,
+                                      unsigned int *highest)
+{
+    (void)pcb;
+    *lowest = 0;
+    *highest = 0;
+    return 0;
+}
+
+extern void stub_set_switch_costs(unsigned int new_switch_cost,
+                                  unsigned int new_migration_cost,
+                                  unsigned int new_idle_cost)
+{
+    (void)new_switch_cost;
+    (void)new_migration_cost;
+    (void)new_idle_cost;
+}
+
+extern void stub_context_switch(unsigned int cpu_id, pcb_t *pcb,
+                                int preemption_time)
+{
+    (void)cpu_id;
+    (void)pcb;
+    (void)preemption_time;
+}
+
+extern void stub_context_switch_batch(unsigned int count,
+                                      const unsigned int *cpu_ids,
+                                      pcb_t *const *pcbs,
+                                      const int *time_slices)
+{
+    (void)count;
+    (void)cpu_ids;
+    (void)pcbs;
+    (void)time_slices;
+}
+
+extern void stub_force_preempt(unsigned int cpu_id)
+{
+    (void)cpu_id;
+}
+
+extern pcb_t *stub_pcb_of(unsigned int pid)
+{
+    return &bench_pcbs[pid];
+}
+
+extern unsigned int stub_pid_count(void)
+{
+    return (unsigned int)bench_max_size;
+}
+
+extern const char *stub_process_name(const pcb_t *pcb)
+{
+    return bench_names[pcb->pid % BENCH_NAMES];
+}
+
+extern unsigned int stub_get_simulator_time(void)
+{
+    return stub_time;
+}
+
+extern void stub_mt_safe_usleep(long usec)
+{
+    (void)usec;
+}
+
+
+static void select_policy(queue_policy_t policy)
+{
+    static const sched_ops_t *const tables[QUEUE_POLICIES] = {
+        &fifo_ops, &priority_ops, &srtf_ops, &fifo_ops, &fair_ops
+    };
+
+    use_policy(tables[policy]);
+    edf = policy == QUEUE_EDF;
+}
+
+/* take() removes the next process as schedule() does, EDF jobs first */
+static pcb_t *take(void)
+{
+    pcb_t *process;
+
+    PROFILE_LOCK(&rq_mutex, PROFILE_RQ_MUTEX);
+    process = pick_ready(0);
+    publish_ready();
+    pthread_mutex_unlock(&rq_mutex);
+    return process;
+}
+
+static void fill(pcb_t *pcbs, unsigned long size)
+{
+    unsigned long n;
+
+    for (n = 0; n < size; n++)
+    {
+        stub_time = (unsigned int)n;
+        push(&pcbs[n]);
+    }
+}
+
+static void drain(void)
+{
+    while (take() != NULL)
+        ;
+}
+
+/*
+ * measure() times pops and pushes at a steady queue size.  Batches start
+ * at one entry and double, so that an O(n) queue at a large size still
+ * finishes within the time budget.
+ */
+static void measure(queue_policy_t policy, pcb_t *pcbs, unsigned long size)
+{
+    static pcb_t *batch[BATCH];
+    unsigned long long start, pop_time = 0, push_time = 0;
+    unsigned long ops = 0, count = 1, n;
+
+    select_policy(policy);
+    fill(pcbs, size);
+
+    while (!bench_done(pop_time + push_time, ops))
+    {
+        start = bench_now();
+        for (n = 0; n < count; n++)
+            batch[n] = take();
+        pop_time += bench_now() - start;
+
+        /* Age the keys, so the entries go back to new positions */
+        stub_time += (unsigned int)size;
+        for (n = 0; n < count; n++)
+        {
+            batch[n]->time_remaining = (batch[n]->time_remaining * 7 + 3) %
+                1000;
+            batch[n]->abs_deadline = stub_time + batch[n]->deadline;
+        }
+
+        start = bench_now();
+        for (n = 0; n < count; n++)
+            push(batch[n]);
+        push_time += bench_now() - start;
+
+        ops += count;
+        if (count * 2 <= BATCH && count * 2 <= size)
+            count *= 2;
+    }
+
+    bench_report("queue", "pop", queue_names[policy], size, ops, pop_time);
+    bench_report("queue", "push", queue_names[policy], size, ops, push_time);
+    drain();
+}
+
+extern void bench_queues(void)
+{
+    pcb_t *pcbs;
+    unsigned long size, n;
+    queue_policy_t policy;
+
+    pcbs = calloc(bench_max_size, sizeof(pcb_t));
+    assert(pcbs != NULL);
+    bench_pcbs = pcbs;
+    for (n = 0; n < bench_max_size; n++)
+    {
+        pcb_t model = {
+            .pid = (unsigned int)n,
+            .time_remaining = (unsigned int)(n * 37 % 1000),
+            .priority = (unsigned int)(n % 10),
+            .deadline = 1 + (unsigned int)(n * 13 % 100),
+            .state = PROCESS_READY,
+            .burst_estimate = 1.0f,
+            .abs_deadline = 1 + (unsigned int)(n * 13 % 100)
+        };
+
+        memcpy(&pcbs[n], &model, sizeof(pcb_t));
+    }
+
+    for (policy = QUEUE_FIFO; policy < QUEUE_POLICIES; policy++)
+    {
+        for (size = 10; size <= bench_max_size; size *= 10)
+            measure(policy, pcbs, size);
+    }
+    free(pcbs);
+}
@@ -0,0 +1,302 @@
+/*
+ * bench-sim.c
+ * Microbenchmarks for the CS 2200 OS Simulation
+ *
+ * Simulator benchmarks.  The simulator is compiled in here against
+ * handlers that do nothing but re-dispatch the process they were given,
+ * so what is measured is the simulator's own locking and signalling:
+ *
+ *   handshake      : the supervisor raising an event on a CPU thread and
+ *                    waiting until its handler has run, as for a timer
+ *                    preemption, burst end or I/O request
+ *   context_switch : a handler dispatching a process to a CPU, or
+ *                    BATCH_CPUS CPUs at once with context_switch_batch()
+ *   force_preempt  : a wake_up() preempting a CPU, through the handler's
+ *                    context_switch() and back
+ *   submit_io / complete_io : queueing I/O requests and completing them
+ *                    (including the wake_up() call), at several depths
+ */
+
+#include "../src/os-sim.c"
+
+#include "bench.h"
+
+
+#define BATCH_CPUS 4
+
+static const op_t bench_io_ops[] = {
+    { OP_CPU, 1 }, { OP_IO, 1 }, { OP_CPU, 1 }, { OP_TERMINATE, 0 }
+};
+
+static void setup(unsigned int cpus);
+static void bench_handshake(void);
+static void bench_context_switch(void);
+static void bench_context_switch_batch(void);
+static void bench_force_preempt(void);
+static void bench_io(unsigned long depth);
+
+
+/* The handlers re-dispatch whatever was running */
+extern void idle(unsigned int cpu_id)
+{
+    (void)cpu_id;
+}
+
+extern void preempt(unsigned int cpu_id)
+{
+    context_switch(cpu_id, simulator_cpu_data[cpu_id].current, -1);
+}
+
+extern void yield(unsigned int cpu_id)
+{
+    context_switch(cpu_id, simulator_cpu_data[cpu_id].current, -1);
+}
+
+extern void terminate(unsigned int cpu_id)
+{
+    context_switch(cpu_id, simulator_cpu_data[cpu_id].current, -1);
+}
+
+extern void wake_up(pcb_t *process)
+{
+    (void)process;
+}
+
+extern void print_scheduler_stats(void)
+{
+}
+
+extern int save_scheduler(FILE *f)
+{
+    (void)f;
+    return -1;
+}
+
+extern int restore_scheduler(FILE *f)
+{
+    (void)f;
+    return -1;
+}
+
+
+/*
+ * setup() does what start_simulator() does short of starting the
+ * supervisor: CPU 0 gets a thread running processes[0], the others (which
+ * have no thread) are only used for context switches.
+ */
+static void setup(unsigned int cpus)
+{
+    unsigned int n;
+
+    cpu_count = cpus;
+    node_cpus = cpu_count;
+    cpu_thread = malloc(sizeof(pthread_t) * cpu_count);
+    assert(cpu_thread != NULL);
+    simulator_cpu_data = malloc(sizeof(simulator_cpu_data_t) * cpu_count);
+    assert(simulator_cpu_data != NULL);
+
+    pthread_mutex_init(&simulator_mutex, NULL);
+    for (n=0; n<cpu_count; n++)
+    {
+        simulator_cpu_data[n].current = NULL;
+        simulator_cpu_data[n].state = CPU_IDLE;
+        simulator_cpu_data[n].preemption_timer = -1;
+        simulator_cpu_data[n].work_start = 0;
+        simulator_cpu_data[n].penalty_until = 0;
+        simulator_cpu_data[n].rate = RATE_ONE;
+        simulator_cpu_data[n].remote = 0;
+        simulator_cpu_data[n].busy_ticks = 0;
+        simulator_cpu_data[n].frequency = 100;
+        simulator_cpu_data[n].idle_since = 0;
+        simulator_cpu_data[n].power_since = 0;
+        memset(simulator_cpu_data[n].residency, 0,
+            sizeof(simulator_cpu_data[n].residency));
+        simulator_cpu_data[n].energy = 0.0;
+        simulator_cpu_data[n].timer.owner = n;
+        capacities[n] = 100;
+        simulator_cpu_data[n].timer.pending = 0;
+#ifdef PROFILE
+        simulator_cpu_data[n].preempt_stamp = 0;
+#endif
+        pthread_cond_init(&simulator_cpu_data[n].wakeup, NULL);
+    }
+    for (n=0; n<RESOURCE_COUNT; n++)
+    {
+        resources[n].holder = PID_NONE;
+        resources[n].head = PID_NONE;
+        resources[n].tail = PID_NONE;
+    }
+    for (n=0; n<PROCESS_COUNT; n++)
+        spawn_process((int)n);
+    wheel_init(&timers, simulator_time);
+    io_timer.owner = IO_TIMER;
+    io_timer.pending = 0;
+    IRWL_INIT(student_lock)
+
+    simulator_cpu_data[0].current = pcb_of(0);
+    pthread_create(&cpu_thread[0], NULL, simulator_cpu_thread_func,
+        (void*)(uintptr_t)0);
+
+    /* Wait for CPU 0 to start "running" its process */
+    pthread_mutex_lock(&simulator_mutex);
+    while (simulator_cpu_data[0].state != CPU_RUNNING)
+    {
+        pthread_mutex_unlock(&simulator_mutex);
+        mt_safe_usleep(1000);
+        pthread_mutex_lock(&simulator_mutex);
+    }
+    pthread_mutex_unlock(&simulator_mutex);
+}
+
+static void bench_handshake(void)
+{
+    unsigned long long start = bench_now(), elapsed = 0;
+    unsigned long ops = 0;
+
+    pthread_mutex_lock(&simulator_mutex);
+    in_tick = 1;
+    while (!bench_done(elapsed, ops))
+    {
+        simulator_cpu_data[0].state = CPU_PREEMPT;
+        pthread_cond_signal(&simulator_cpu_data[0].wakeup);
+        pthread_cond_wait(&simulator_cpu_data[0].wakeup, &simulator_mutex);
+        ops++;
+        elapsed = bench_now() - start;
+    }
+    in_tick = 0;
+    pthread_mutex_unlock(&simulator_mutex);
+
+    bench_report("simulator", "handshake", "preempt", 1, ops, elapsed);
+}
+
+static void bench_context_switch(void)
+{
+    unsigned long long start = bench_now(), elapsed = 0;
+    unsigned long ops = 0;
+
+    IRWL_WRITER_LOCK(student_lock)
+    while (!bench_done(elapsed, ops))
+    {
+        context_switch(1, pcb_of(1 + ops % 2), -1);
+        ops++;
+        elapsed = bench_now() - start;
+    }
+    IRWL_WRITER_UNLOCK(student_lock)
+
+    bench_report("simulator", "context_switch", "cpu", 1, ops, elapsed);
+}
+
+/*
+ * bench_context_switch_batch() dispatches CPUs 1 to BATCH_CPUS together, a
+ * different process to each every round; ops counts CPUs, so the cost is
+ * per CPU, as for context_switch.
+ */
+static void bench_context_switch_batch(void)
+{
+    unsigned long long start = bench_now(), elapsed = 0;
+    unsigned long ops = 0;
+    unsigned int cpus[BATCH_CPUS], n;
+    pcb_t *pcbs[BATCH_CPUS];
+    int slices[BATCH_CPUS];
+
+    for (n = 0; n < BATCH_CPUS; n++)
+    {
+        cpus[n] = n + 1;
+        slices[n] = -1;
+    }
+
+    IRWL_WRITER_LOCK(student_lock)
+    while (!bench_done(elapsed, ops))
+    {
+        for (n = 0; n < BATCH_CPUS; n++)
+            pcbs[n] = pcb_of(1 + (unsigned int)(ops / BATCH_CPUS + n) %
+                (PROCESS_COUNT - 1));
+        context_switch_batch(BATCH_CPUS, cpus, pcbs, slices);
+        ops += BATCH_CPUS;
+        elapsed = bench_now() - start;
+    }
+    IRWL_WRITER_UNLOCK(student_lock)
+
+    bench_report("simulator", "context_switch", "batch", BATCH_CPUS, ops,
+        elapsed);
+}
+
+static void bench_force_preempt(void)
+{
+    unsigned long long start = bench_now(), elapsed = 0;
+    unsigned long ops = 0;
+
+    IRWL_WRITER_LOCK(student_lock)
+    while (!bench_done(elapsed, ops))
+    {
+        force_preempt(0);
+        ops++;
+        elapsed = bench_now() - start;
+    }
+    IRWL_WRITER_UNLOCK(student_lock)
+
+    bench_report("simulator", "force_preempt", "round_trip", 1, ops,
+        elapsed);
+}
+
+/*
+ * bench_io() queues depth requests at a time, then completes them all, as
+ * the supervisor would (with the simulator_mutex held, inside a tick).  The
+ * processes doing the I/O are added to the process table for the purpose.
+ */
+static void bench_io(unsigned long depth)
+{
+    unsigned long long start, submit_time = 0, complete_time = 0;
+    unsigned long ops = 0, n;
+    pcb_t **pcbs;
+
+    pcbs = malloc(sizeof(pcb_t *) * depth);
+    assert(pcbs != NULL);
+    for (n = 0; n < depth; n++)
+    {
+        pcbs[n] = spawn_process(0);
+        pcbs[n]->state = PROCESS_WAITING;
+        program[pcbs[n]->pid] = bench_io_ops;
+    }
+
+    pthread_mutex_lock(&simulator_mutex);
+    in_tick = 1;
+    while (!bench_done(submit_time + complete_time, ops))
+    {
+        for (n = 0; n < depth; n++)
+            cursor[pcbs[n]->pid].op = 1;
+
+        start = bench_now();
+        for (n = 0; n < depth; n++)
+            submit_io_request(pcbs[n], 1);
+        submit_time += bench_now() - start;
+
+        start = bench_now();
+        for (n = 0; n < depth; n++)
+            simulate_io();
+        complete_time += bench_now() - start;
+
+        ops += depth;
+    }
+    wheel_cancel(&io_timer);
+    in_tick = 0;
+    pthread_mutex_unlock(&simulator_mutex);
+    free(pcbs);
+
+    bench_report("simulator", "submit_io", "fifo", depth, ops, submit_time);
+    bench_report("simulator", "complete_io", "fifo", depth, ops,
+        complete_time);
+}
+
+extern void bench_simulator(void)
+{
+    unsigned long depth;
+
+    setup(1 + BATCH_CPUS);
+    bench_handshake();
+    bench_context_switch();
+    bench_context_switch_batch();
+    bench_force_preempt();
+    for (depth = 10; depth <= bench_max_size && depth <= 100000; depth *= 100)
+        bench_io(depth);
+}
@@ -0,0 +1,98 @@
+/*
+ * bench.c
+ * Microbenchmarks for the CS 2200 OS Simulation
+ *
+ * Runs the scheduler and simulator microbenchmarks and prints one CSV row
+ * per measurement:
+ *
+ *   suite,benchmark,variant,size,ops,ns_per_op,ops_per_sec
+ *
+ * so that changes to the ready queues or the simulator's locking can be
+ * compared by numbers.  "make bench" builds and runs it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+
+#define MIN_OPS 16
+
+unsigned long long bench_budget = 200000000ull;
+unsigned long bench_max_size = 1000000;
+
+static void help(void);
+
+
+static void help(void)
+{
+    fprintf(stderr, "CS 2200 Project 4 -- Microbenchmarks\n"
+        "Usage: ./os-bench [-t <ms>] [-n <entries>] [-q | -s]\n"
+        "    -t : Time spent on each measurement, in milliseconds "
+        "(default 200)\n"
+        "    -n : Largest ready queue measured (default 1000000)\n"
+        "    -q : Only run the ready queue benchmarks\n"
+        "    -s : Only run the simulator benchmarks\n");
+}
+
+extern unsigned long long bench_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull +
+        (unsigned long long)now.tv_nsec;
+}
+
+extern int bench_done(unsigned long long elapsed, unsigned long ops)
+{
+    return elapsed >= bench_budget && ops >= MIN_OPS;
+}
+
+extern void bench_report(const char *suite, const char *benchmark,
+                         const char *variant, unsigned long size,
+                         unsigned long ops, unsigned long long elapsed)
+{
+    double ns = ops ? (double)elapsed / (double)ops : 0.0;
+
+    printf("%s,%s,%s,%lu,%lu,%.1f,%.0f\n", suite, benchmark, variant, size,
+        ops, ns, ns > 0.0 ? 1e9 / ns : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int queues = 1, simulator = 1, n;
+
+    for (n = 1; n < argc; n++)
+    {
+        if (strcmp(argv[n], "-t") == 0 && n + 1 < argc)
+            bench_budget = strtoull(argv[++n], NULL, 0) * 1000000ull;
+        else if (strcmp(argv[n], "-n") == 0 && n + 1 < argc)
+            bench_max_size = strtoul(argv[++n], NULL, 0);
+        else if (strcmp(argv[n], "-q") == 0)
+            simulator = 0;
+        else if (strcmp(argv[n], "-s") == 0)
+            queues = 0;
+        else
+        {
+            help();
+            return -1;
+        }
+    }
+    if (bench_budget == 0 || bench_max_size < 10)
+    {
+        help();
+        return -1;
+    }
+
+    printf("suite,benchmark,variant,size,ops,ns_per_op,ops_per_sec\n");
+    if (queues)
+        bench_queues();
+    if (simulator)
+        bench_simulator();
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * bench.h
+ * Microbenchmarks for the CS 2200 OS Simulation
+ *
+ * The benchmarks are split by the code they measure: bench-queue.c builds
+ * the scheduler (student.c) against a stub simulator, bench-sim.c the
+ * simulator (os-sim.c) against stub handlers.  bench.c drives both.
+ */
+
+#pragma once
+
+
+/*
+ * bench_budget is how long (in ns) each measurement runs for, and
+ * bench_max_size the largest queue size measured.
+ *
+ *   bench_now()     : monotonic host time in nanoseconds
+ *   bench_done()    : whether a measurement that has taken elapsed ns for
+ *                     ops operations has run long enough
+ *   bench_report()  : prints the result row of a measurement
+ *   bench_queues()  : the ready queue benchmarks (bench-queue.c)
+ *   bench_simulator() : the simulator benchmarks (bench-sim.c)
+ */
+extern unsigned long long bench_budget;
+extern unsigned long bench_max_size;
+
+extern unsigned long long bench_now(void);
+extern int bench_done(unsigned long long elapsed, unsigned long ops);
+extern void bench_report(const char *suite, const char *benchmark,
+                         const char *variant, unsigned long size,
+                         unsigned long ops, unsigned long long elapsed);
+
+extern void bench_queues(void);
+extern void bench_simulator(void);
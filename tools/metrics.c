@@ -0,0 +1,209 @@
+/*
+ * metrics.c
+ * Live metrics reader for the CS 2200 OS Simulation
+ *
+ * Samples the shared memory segment a simulator started with -M <name>
+ * publishes (see src/metrics.h), and prints one line per sample.  Reading
+ * takes no lock the simulator uses: a sample copied while the supervisor
+ * was rewriting the segment is simply taken again.  It exits once the
+ * simulation is over, or after the requested number of samples.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "metrics.h"
+
+
+/* A sample still torn after this many tries is skipped */
+#define MAX_TRIES 1000
+
+static void help(void);
+static int take_sample(const metrics_t *segment, metrics_t *sample,
+                       unsigned int *retries);
+static void print_sample(const metrics_t *sample, unsigned int retries);
+static void sleep_ms(unsigned long ms);
+
+
+static void help(void)
+{
+    fprintf(stderr, "CS 2200 Project 4 -- Live Metrics Reader\n"
+            "Usage: ./os-metrics [options] <shm name>\n"
+            "    -i <ms>    : sampling interval   (default 100, 0 as fast\n"
+            "                 as possible)\n"
+            "    -n <count> : stop after this many samples (default: when\n"
+            "                 the simulation is over)\n"
+            "    -u         : remove the segment on exit\n"
+            "  <shm name> is the name given to ./os-sim -M.  Each line has\n"
+            "  the tick, the processes running, ready and waiting, the I/O\n"
+            "  queue depth, context switches so far, and the pid on each\n"
+            "  CPU (- for idle).\n\n");
+}
+
+
+/*
+ * take_sample() copies the segment into sample under the seqlock protocol
+ * of metrics.h, and counts in retries the copies it had to throw away.
+ * Returns 0, or -1 if the writer kept it busy for MAX_TRIES tries.
+ */
+static int take_sample(const metrics_t *segment, metrics_t *sample,
+                       unsigned int *retries)
+{
+    uint32_t before, after;
+    unsigned int tries, n;
+
+    for (tries = 0; tries < MAX_TRIES; tries++)
+    {
+        before = __atomic_load_n(&segment->seq, __ATOMIC_ACQUIRE);
+        if (before & 1u)
+        {
+            (*retries)++;
+            sched_yield();
+            continue;
+        }
+
+        sample->magic = METRICS_LOAD(segment->magic);
+        sample->version = METRICS_LOAD(segment->version);
+        sample->cpu_count = METRICS_LOAD(segment->cpu_count);
+        sample->tick = METRICS_LOAD(segment->tick);
+        sample->ready = METRICS_LOAD(segment->ready);
+        sample->running = METRICS_LOAD(segment->running);
+        sample->waiting = METRICS_LOAD(segment->waiting);
+        sample->io_queue = METRICS_LOAD(segment->io_queue);
+        sample->context_switches = METRICS_LOAD(segment->context_switches);
+        sample->migrations = METRICS_LOAD(segment->migrations);
+        sample->processes_created = METRICS_LOAD(segment->processes_created);
+        sample->processes_terminated =
+            METRICS_LOAD(segment->processes_terminated);
+        sample->done = METRICS_LOAD(segment->done);
+        for (n=0; n<METRICS_CPUS; n++)
+            sample->cpu_pid[n] = METRICS_LOAD(segment->cpu_pid[n]);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+        if (before == after)
+        {
+            sample->seq = before;
+            return 0;
+        }
+        (*retries)++;
+    }
+    return -1;
+}
+
+static void print_sample(const metrics_t *sample, unsigned int retries)
+{
+    unsigned int n;
+
+    printf("%-7.1f %3u %3u %3u %4u %8u %6u/%-6u ",
+        (float)sample->tick / 10.0, sample->running, sample->ready,
+        sample->waiting, sample->io_queue, sample->context_switches,
+        sample->processes_terminated, sample->processes_created);
+    for (n=0; n<sample->cpu_count && n<METRICS_CPUS; n++)
+    {
+        if (sample->cpu_pid[n] == METRICS_IDLE)
+            printf(" %5s", "-");
+        else
+            printf(" %5u", sample->cpu_pid[n]);
+    }
+    printf("  %u\n", retries);
+    fflush(stdout);
+}
+
+static void sleep_ms(unsigned long ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(ms / 1000);
+    ts.tv_nsec = (long)(ms % 1000) * 1000000l;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned long interval = 100, count = 0, taken = 0;
+    unsigned int retries = 0;
+    const char *name;
+    const metrics_t *segment;
+    metrics_t sample;
+    void *mapping;
+    int opt, fd, unlink_on_exit = 0;
+
+    while ((opt = getopt(argc, argv, "i:n:uh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            unlink_on_exit = 1;
+            break;
+        default:
+            help();
+            return -1;
+        }
+    }
+    if (optind + 1 != argc)
+    {
+        help();
+        return -1;
+    }
+    name = argv[optind];
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        perror(name);
+        return -1;
+    }
+    mapping = mmap(NULL, sizeof(metrics_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        perror(name);
+        return -1;
+    }
+    segment = mapping;
+
+    printf("Time    Run Rdy Wai  I/O Switches  Done/Made  Pid on each CPU"
+           "  Retries\n");
+    while (count == 0 || taken < count)
+    {
+        /* A segment just created has not been written yet */
+        if (take_sample(segment, &sample, &retries) == 0 &&
+            sample.magic != 0)
+        {
+            if (sample.magic != METRICS_MAGIC ||
+                sample.version != METRICS_VERSION)
+            {
+                fprintf(stderr, "%s: not a simulator metrics segment\n",
+                    name);
+                return -1;
+            }
+            print_sample(&sample, retries);
+            retries = 0;
+            taken++;
+            if (sample.done)
+                break;
+        }
+        if (interval > 0)
+            sleep_ms(interval);
+    }
+
+    munmap(mapping, sizeof(metrics_t));
+    if (unlink_on_exit)
+        shm_unlink(name);
+    return 0;
+}
@@ -0,0 +1,542 @@
+/*
+ * scenarios.c
+ * Scenario regression suite for the CS 2200 OS Simulation
+ *
+ * Runs ./os-sim, in deterministic mode (-D), over the scenarios listed in a
+ * golden file, and checks each run's scheduling metrics against the golden
+ * values and its host wall-clock time against a budget.  Each line of the
+ * golden file is one scenario:
+ *
+ *   <os-sim arguments> | <context switches> | <execution time> |
+ *       <READY time> | <wall-clock budget in ms> [ | <statistics line> ...]
+ *
+ * A statistics line pins a line of the final statistics that the three
+ * metrics do not cover, such as energy or lock waits.  The output line is
+ * the one that starts with the same label (the text up to its first ':'),
+ * and its numbers are checked in order against those given, each to the
+ * precision it is written with; numbers past the last one given are not
+ * checked.
+ *
+ * Blank lines and lines starting with '#' are kept as they are.  With -u
+ * the metrics are rewritten from the current simulator (and lines with
+ * only arguments filled in), which is how the golden values are made.
+ *
+ * An argument @<tick> is not passed on: the scenario is instead run once
+ * with a checkpoint saved at <tick> (-C), then again restored from that
+ * checkpoint (-L), and the metrics are those of the restored run.  Its
+ * golden values are the same as those of the scenario without @<tick>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define MAX_ARGS 32
+#define MAX_EXTRAS 4
+#define LINE_LENGTH 1024
+
+/*
+ * extras[] holds the statistics lines a scenario pins: the golden text, or
+ * the matching output line ("" if the run printed none).
+ */
+typedef struct {
+    unsigned int switches;
+    double exec_time;
+    double ready_time;
+    unsigned int extra_count;
+    char extras[MAX_EXTRAS][LINE_LENGTH];
+} metrics_t;
+
+typedef struct {
+    char args[LINE_LENGTH];
+    int has_golden;
+    metrics_t golden;
+    unsigned int budget;
+} scenario_t;
+
+static const char *simulator_path = "./os-sim";
+static double tolerance = 0.01;
+
+static void help(void);
+static int parse_scenario(const char *line, scenario_t *scenario);
+static size_t label_length(const char *text);
+static int next_number(const char **text, double *value, double *slack);
+static int extra_matches(const char *output, const char *golden);
+static void extra_update(char *row, size_t size, const char *output,
+                         const char *golden);
+static int run_simulator(char *const argv[], const metrics_t *golden,
+                         metrics_t *metrics);
+static int run_scenario(const scenario_t *scenario, metrics_t *metrics,
+                        double *wall);
+static int within(double value, double golden, double slack);
+
+
+static void help(void)
+{
+    fprintf(stderr, "CS 2200 Project 4 -- Scenario Regression Suite\n"
+            "Usage: ./os-scenarios [options]\n"
+            "    -g <path>  : golden file (default tools/scenarios.golden)\n"
+            "    -b <path>  : simulator binary (default ./os-sim)\n"
+            "    -e <pct>   : relative tolerance on metrics, in percent\n"
+            "                 (default 1)\n"
+            "    -u         : rewrite the golden values from this simulator\n"
+            "  Exits with status 1 if any scenario fails.\n\n");
+}
+
+/*
+ * parse_scenario() splits a golden file line into the arguments and, if
+ * present, the golden metrics and budget.  Returns 0 for a comment or
+ * blank line, 1 for a scenario, or -1 for a malformed line.
+ */
+static int parse_scenario(const char *line, scenario_t *scenario)
+{
+    const char *bar = strchr(line, '|');
+    size_t length;
+    unsigned int n;
+
+    while (*line == ' ' || *line == '\t')
+        line++;
+    if (*line == '#' || *line == '\n' || *line == '\0')
+        return 0;
+
+    length = bar ? (size_t)(bar - line) : strcspn(line, "\n");
+    while (length > 0 && (line[length - 1] == ' ' || line[length - 1] == '\t'))
+        length--;
+    if (length == 0 || length >= sizeof(scenario->args))
+        return -1;
+    memcpy(scenario->args, line, length);
+    scenario->args[length] = '\0';
+
+    scenario->has_golden = 0;
+    scenario->budget = 0;
+    scenario->golden.extra_count = 0;
+    if (bar == NULL)
+        return 1;
+
+    if (sscanf(bar, "| %u | %lf | %lf | %u", &scenario->golden.switches,
+               &scenario->golden.exec_time, &scenario->golden.ready_time,
+               &scenario->budget) != 4)
+        return -1;
+    scenario->has_golden = 1;
+
+    /* Any fields after the budget are statistics lines */
+    scenario->golden.extra_count = 0;
+    for (n = 0; n < 3 && bar != NULL; n++)
+        bar = strchr(bar + 1, '|');
+    while (bar != NULL && (bar = strchr(bar + 1, '|')) != NULL)
+    {
+        char *extra = scenario->golden.extras[scenario->golden.extra_count];
+
+        line = bar + 1;
+        while (*line == ' ' || *line == '\t')
+            line++;
+        length = strcspn(line, "|\n");
+        while (length > 0 &&
+               (line[length - 1] == ' ' || line[length - 1] == '\t'))
+            length--;
+        if (length == 0 || length >= LINE_LENGTH ||
+            scenario->golden.extra_count == MAX_EXTRAS)
+            return -1;
+        memcpy(extra, line, length);
+        extra[length] = '\0';
+        scenario->golden.extra_count++;
+    }
+    return 1;
+}
+
+/* label_length() is the length of the label of a statistics line */
+static size_t label_length(const char *text)
+{
+    const char *colon = strchr(text, ':');
+
+    return colon ? (size_t)(colon - text) + 1 : strlen(text);
+}
+
+/*
+ * next_number() finds the next number in *text and moves *text past it.
+ * slack is one unit in its last written digit.
+ */
+static int next_number(const char **text, double *value, double *slack)
+{
+    const char *start = *text, *dot;
+    char *end;
+
+    while (*start != '\0' && (*start < '0' || *start > '9'))
+        start++;
+    if (*start == '\0')
+        return 0;
+
+    *value = strtod(start, &end);
+    *slack = 1.0;
+    dot = memchr(start, '.', (size_t)(end - start));
+    if (dot != NULL)
+    {
+        for (dot++; dot < end; dot++)
+            *slack /= 10.0;
+    }
+    *text = end;
+    return 1;
+}
+
+/* extra_matches() checks an output line against a golden statistics line */
+static int extra_matches(const char *output, const char *golden)
+{
+    double expected, actual, slack, ignored;
+
+    if (output[0] == '\0')
+        return 0;
+    golden += label_length(golden);
+    output += label_length(output);
+    while (next_number(&golden, &expected, &slack))
+    {
+        if (!next_number(&output, &actual, &ignored) ||
+            !within(actual, expected, slack))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * extra_update() appends to row the output line cut after as many numbers
+ * as the golden line has, or the whole line if the golden one has none.
+ * A line the run did not print keeps its golden text, and fails.
+ */
+static void extra_update(char *row, size_t size, const char *output,
+                         const char *golden)
+{
+    const char *end = output + label_length(output);
+    double value, slack;
+    size_t used = strlen(row);
+    int numbers = 0;
+
+    if (output[0] == '\0')
+    {
+        snprintf(row + used, size - used, " | %s", golden);
+        return;
+    }
+    golden += label_length(golden);
+    while (next_number(&golden, &value, &slack))
+    {
+        next_number(&end, &value, &slack);
+        numbers++;
+    }
+    if (numbers == 0)
+        end = output + strlen(output);
+    snprintf(row + used, size - used, " | %.*s", (int)(end - output),
+             output);
+}
+
+/*
+ * run_simulator() runs the simulator with argv and scrapes its final
+ * statistics, and the lines with the labels of golden's statistics lines.
+ */
+static int run_simulator(char *const argv[], const metrics_t *golden,
+                         metrics_t *metrics)
+{
+    char line[LINE_LENGTH];
+    int fds[2], status, found = 0;
+    unsigned int n;
+    pid_t pid;
+    FILE *out;
+
+    metrics->extra_count = golden->extra_count;
+    for (n = 0; n < golden->extra_count; n++)
+        metrics->extras[n][0] = '\0';
+
+    if (pipe(fds) != 0)
+        return -1;
+
+    pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    out = fdopen(fds[0], "r");
+    assert(out != NULL);
+    while (fgets(line, sizeof(line), out) != NULL)
+    {
+        if (sscanf(line, "# of Context Switches: %u",
+                   &metrics->switches) == 1)
+            found |= 1;
+        else if (sscanf(line, "Total execution time: %lf",
+                        &metrics->exec_time) == 1)
+            found |= 2;
+        else if (sscanf(line, "Total time spent in READY state: %lf",
+                        &metrics->ready_time) == 1)
+            found |= 4;
+
+        for (n = 0; n < golden->extra_count; n++)
+        {
+            size_t length = label_length(golden->extras[n]);
+
+            if (metrics->extras[n][0] == '\0' &&
+                strncmp(line, golden->extras[n], length) == 0)
+            {
+                line[strcspn(line, "\n")] = '\0';
+                snprintf(metrics->extras[n], LINE_LENGTH, "%s", line);
+            }
+        }
+    }
+    fclose(out);
+
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || found != 7)
+        return -1;
+    return 0;
+}
+
+/*
+ * run_scenario() runs the simulator on the scenario's arguments, twice for
+ * a checkpoint round trip.  wall is the host time the runs took, in ms.
+ */
+static int run_scenario(const scenario_t *scenario, metrics_t *metrics,
+                        double *wall)
+{
+    char args[LINE_LENGTH], path[LINE_LENGTH], spec[LINE_LENGTH];
+    char checkpoint[] = "/tmp/os-scenarios-XXXXXX";
+    char flag_d[] = "-D", flag_c[] = "-C", flag_l[] = "-L";
+    char *argv[MAX_ARGS + 5], *item, *save = NULL, *end;
+    unsigned long tick = 0;
+    int argc = 0, fd, result;
+    struct timespec start, stop;
+
+    snprintf(path, sizeof(path), "%s", simulator_path);
+    snprintf(args, sizeof(args), "%s", scenario->args);
+
+    argv[argc++] = path;
+    for (item = strtok_r(args, " \t", &save); item != NULL;
+         item = strtok_r(NULL, " \t", &save))
+    {
+        if (item[0] == '@')
+        {
+            tick = strtoul(item + 1, &end, 0);
+            if (end == item + 1 || *end != '\0' || tick == 0)
+                return -1;
+            continue;
+        }
+        if (argc > MAX_ARGS)
+            return -1;
+        argv[argc++] = item;
+    }
+    argv[argc++] = flag_d;
+    argv[argc] = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (tick == 0)
+    {
+        result = run_simulator(argv, &scenario->golden, metrics);
+    }
+    else
+    {
+        fd = mkstemp(checkpoint);
+        if (fd < 0)
+            return -1;
+        close(fd);
+
+        snprintf(spec, sizeof(spec), "%lu:%s", tick, checkpoint);
+        argv[argc] = flag_c;
+        argv[argc + 1] = spec;
+        argv[argc + 2] = NULL;
+        result = run_simulator(argv, &scenario->golden, metrics);
+
+        argv[argc] = flag_l;
+        argv[argc + 1] = checkpoint;
+        if (result == 0)
+            result = run_simulator(argv, &scenario->golden, metrics);
+        unlink(checkpoint);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    *wall = (double)(stop.tv_sec - start.tv_sec) * 1000.0 +
+        (double)(stop.tv_nsec - start.tv_nsec) / 1e6;
+
+    return result;
+}
+
+/*
+ * Times are printed to a tenth of a second, so they get that much slack on
+ * top of the relative tolerance.
+ */
+static int within(double value, double golden, double slack)
+{
+    double diff = value > golden ? value - golden : golden - value;
+
+    return diff <= golden * tolerance + slack;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *golden_path = "tools/scenarios.golden";
+    char line[LINE_LENGTH], row[LINE_LENGTH * 3], **lines = NULL;
+    unsigned int line_count = 0, capacity = 0, n;
+    unsigned int scenarios = 0, failures = 0;
+    unsigned long total_switches = 0;
+    double total_wall = 0.0;
+    int update = 0, kind;
+    FILE *golden;
+
+    for (n = 1; n < (unsigned int)argc; n++)
+    {
+        if (strcmp(argv[n], "-g") == 0 && n + 1 < (unsigned int)argc)
+            golden_path = argv[++n];
+        else if (strcmp(argv[n], "-b") == 0 && n + 1 < (unsigned int)argc)
+            simulator_path = argv[++n];
+        else if (strcmp(argv[n], "-e") == 0 && n + 1 < (unsigned int)argc)
+            tolerance = strtod(argv[++n], NULL) / 100.0;
+        else if (strcmp(argv[n], "-u") == 0)
+            update = 1;
+        else
+        {
+            help();
+            return 2;
+        }
+    }
+
+    /* The whole file is read first, so that -u can rewrite it */
+    golden = fopen(golden_path, "r");
+    if (golden == NULL)
+    {
+        fprintf(stderr, "scenarios: cannot read %s\n", golden_path);
+        return 2;
+    }
+    while (fgets(line, sizeof(line), golden) != NULL)
+    {
+        if (line_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            lines = realloc(lines, sizeof(char *) * capacity);
+            assert(lines != NULL);
+        }
+        lines[line_count] = strdup(line);
+        assert(lines[line_count] != NULL);
+        line_count++;
+    }
+    fclose(golden);
+
+    for (n = 0; n < line_count; n++)
+    {
+        scenario_t scenario;
+        metrics_t metrics;
+        int extras_ok[MAX_EXTRAS];
+        unsigned int k;
+        double wall;
+        int ok;
+
+        kind = parse_scenario(lines[n], &scenario);
+        if (kind == 0)
+            continue;
+        if (kind < 0)
+        {
+            fprintf(stderr, "scenarios: %s:%u: malformed line\n",
+                golden_path, n + 1);
+            return 2;
+        }
+
+        scenarios++;
+        if (run_scenario(&scenario, &metrics, &wall) != 0)
+        {
+            printf("FAIL  %-32s  run failed\n", scenario.args);
+            failures++;
+            continue;
+        }
+        total_switches += metrics.switches;
+        total_wall += wall;
+
+        if (update)
+        {
+            /* Keep a budget once set; new ones get 4x the current time */
+            unsigned int budget = scenario.budget ? scenario.budget :
+                (unsigned int)(wall * 4.0 / 500.0 + 1.0) * 500;
+
+            snprintf(row, sizeof(row), "%-32s | %5u | %6.1f | %7.1f | %u",
+                scenario.args, metrics.switches, metrics.exec_time,
+                metrics.ready_time, budget);
+            for (k = 0; k < metrics.extra_count; k++)
+                extra_update(row, sizeof(row) - 1, metrics.extras[k],
+                    scenario.golden.extras[k]);
+            strcat(row, "\n");
+            free(lines[n]);
+            lines[n] = strdup(row);
+            assert(lines[n] != NULL);
+            printf("%s", row);
+            continue;
+        }
+
+        if (!scenario.has_golden)
+        {
+            printf("FAIL  %-32s  no golden values (run with -u)\n",
+                scenario.args);
+            failures++;
+            continue;
+        }
+
+        ok = within(metrics.switches, scenario.golden.switches, 0.0) &&
+            within(metrics.exec_time, scenario.golden.exec_time, 0.1) &&
+            within(metrics.ready_time, scenario.golden.ready_time, 0.1) &&
+            wall <= scenario.budget;
+        for (k = 0; k < metrics.extra_count; k++)
+            extras_ok[k] = extra_matches(metrics.extras[k],
+                scenario.golden.extras[k]);
+        for (k = 0; k < metrics.extra_count; k++)
+            ok = ok && extras_ok[k];
+        if (!ok)
+            failures++;
+
+        printf("%s  %-32s  switches %u (%u), exec %.1f s (%.1f), "
+            "ready %.1f s (%.1f), wall %.0f ms (budget %u), %.0f events/s\n",
+            ok ? "ok  " : "FAIL", scenario.args, metrics.switches,
+            scenario.golden.switches, metrics.exec_time,
+            scenario.golden.exec_time, metrics.ready_time,
+            scenario.golden.ready_time, wall, scenario.budget,
+            wall > 0.0 ? metrics.switches * 1000.0 / wall : 0.0);
+        for (k = 0; k < metrics.extra_count; k++)
+        {
+            if (!extras_ok[k])
+                printf("      expected \"%s\"\n      got      \"%s\"\n",
+                    scenario.golden.extras[k], metrics.extras[k][0] ?
+                    metrics.extras[k] : "(no such line)");
+        }
+    }
+
+    if (update)
+    {
+        golden = fopen(golden_path, "w");
+        if (golden == NULL)
+        {
+            fprintf(stderr, "scenarios: cannot write %s\n", golden_path);
+            return 2;
+        }
+        for (n = 0; n < line_count; n++)
+            fputs(lines[n], golden);
+        fclose(golden);
+    }
+
+    printf("\n%u scenarios, %u failed; %.1f s wall, %.0f events/s "
+        "(context switches per host second)\n", scenarios, failures,
+        total_wall / 1000.0,
+        total_wall > 0.0 ? total_switches * 1000.0 / total_wall : 0.0);
+
+    for (n = 0; n < line_count; n++)
+        free(lines[n]);
+    free(lines);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,620 @@
+
+/*
+ * sweep.c
+ * Parameter sweep driver for the CS 2200 OS Simulation
+ *
+ * Runs ./os-sim over every combination of CPU count, scheduler, time slice,
+ * workload seed and offered load.  The runs are independent processes, so a pool of
+ * worker threads pulls jobs off a shared queue and keeps every host core
+ * busy.  Each finished run is appended to a CSV journal straight away; on
+ * restart, rows already in the journal are skipped, so an interrupted sweep
+ * (Ctrl-C) resumes where it stopped.
+ */
+
+#define _GNU_SOURCE     /* pipe2() */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#define MAX_VALUES 256
+#define LINE_LENGTH 512
+
+/* The key columns of a journal row, in order */
+#define JOURNAL_HEADER "cpus,scheduler,timeslice,seed,load,horizon,"
+
+typedef enum { POLICY_FIFO = 0, POLICY_RR, POLICY_PRIORITY } policy_t;
+
+static const char *policy_names[] = { "fifo", "rr", "prio" };
+#define POLICY_COUNT (sizeof(policy_names) / sizeof(policy_names[0]))
+
+typedef struct {
+    unsigned int cpus;
+    policy_t policy;
+    int timeslice;
+    unsigned int seed;
+    unsigned int load;
+    unsigned int horizon;
+    int done;
+} job_t;
+
+/*
+ * The statistics scraped from one run.  An open-workload run in which no
+ * process finished by the horizon has a throughput of 0 and no turnaround
+ * (finished is 0); the journal leaves its turnaround fields empty.
+ */
+typedef struct {
+    unsigned int switches;
+    double exec_time;
+    double ready_time;
+    double throughput;
+    int finished;
+    double mean_turnaround;
+    double p95_turnaround;
+} result_t;
+
+typedef struct {
+    unsigned int values[MAX_VALUES];
+    unsigned int count;
+} range_t;
+
+static job_t *jobs;
+static unsigned int job_count;
+static unsigned int next_job;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static FILE *journal;
+static const char *simulator_path = "./os-sim";
+static unsigned int horizon = 3000;
+static volatile sig_atomic_t cancelled = 0;
+
+static void help(void);
+static int parse_range(const char *spec, range_t *range);
+static int parse_policies(const char *spec, int *enabled);
+static void build_jobs(const range_t *cpus, const int *policies,
+                       const range_t *slices, const range_t *seeds,
+                       const range_t *loads);
+static int load_journal(const char *path);
+static int run_job(const job_t *job, result_t *result);
+static void *worker_thread_func(void *data);
+static void write_json(const char *journal_path, const char *json_path);
+static void on_signal(int sig);
+
+
+static void help(void)
+{
+    fprintf(stderr, "CS 2200 Project 4 -- Parameter Sweep\n"
+            "Usage: ./sweep -o <results.csv> [options]\n"
+            "    -c <range> : CPU counts            (default 1-4)\n"
+            "    -p <list>  : schedulers fifo,rr,prio (default all)\n"
+            "    -t <range> : round-robin time slices (default 2-8:2)\n"
+            "    -s <range> : workload seeds        (default 0)\n"
+            "    -l <range> : offered loads, Poisson arrivals per minute;\n"
+            "                 0 is the closed workload (default 0)\n"
+            "    -T <ticks> : horizon of open-workload runs (default 3000)\n"
+            "    -j <n>     : parallel runs         (default: host cores)\n"
+            "    -b <path>  : simulator binary      (default ./os-sim)\n"
+            "    -J <path>  : also write the full table as JSON\n"
+            "  A range is a list of values or spans, e.g. 1,2,4 or 2-8:2.\n"
+            "  Rows already in the CSV are skipped, so a cancelled sweep\n"
+            "  resumes when run again with the same output file.\n\n");
+}
+
+
+/*
+ * parse_range() accepts comma separated items, each either a value "N" or a
+ * span "A-B" with an optional step "A-B:S".
+ */
+static int parse_range(const char *spec, range_t *range)
+{
+    char buf[LINE_LENGTH];
+    char *item, *save = NULL;
+
+    range->count = 0;
+    if (strlen(spec) >= sizeof(buf))
+        return -1;
+    strcpy(buf, spec);
+
+    for (item = strtok_r(buf, ",", &save); item != NULL;
+         item = strtok_r(NULL, ",", &save))
+    {
+        unsigned long lo, hi, step = 1, v;
+        char *end;
+
+        lo = strtoul(item, &end, 0);
+        if (end == item)
+            return -1;
+        hi = lo;
+        if (*end == '-')
+        {
+            item = end + 1;
+            hi = strtoul(item, &end, 0);
+            if (end == item || hi < lo)
+                return -1;
+        }
+        if (*end == ':')
+        {
+            item = end + 1;
+            step = strtoul(item, &end, 0);
+            if (end == item || step == 0)
+                return -1;
+        }
+        if (*end != '\0')
+            return -1;
+
+        for (v = lo; v <= hi; v += step)
+        {
+            if (range->count >= MAX_VALUES)
+                return -1;
+            range->values[range->count++] = (unsigned int)v;
+        }
+    }
+
+    return range->count > 0 ? 0 : -1;
+}
+
+static int parse_policies(const char *spec, int *enabled)
+{
+    char buf[LINE_LENGTH];
+    char *item, *save = NULL;
+    unsigned int n;
+
+    memset(enabled, 0, sizeof(int) * POLICY_COUNT);
+    if (strlen(spec) >= sizeof(buf))
+        return -1;
+    strcpy(buf, spec);
+
+    for (item = strtok_r(buf, ",", &save); item != NULL;
+         item = strtok_r(NULL, ",", &save))
+    {
+        for (n = 0; n < POLICY_COUNT; n++)
+        {
+            if (strcmp(item, policy_names[n]) == 0)
+                break;
+        }
+        if (n == POLICY_COUNT)
+            return -1;
+        enabled[n] = 1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * build_jobs() expands the cross product.  The time slice only matters to
+ * round-robin, so the other schedulers get a single job per combination
+ * with a time slice of -1 (infinite).
+ */
+static void build_jobs(const range_t *cpus, const int *policies,
+                       const range_t *slices, const range_t *seeds,
+                       const range_t *loads)
+{
+    unsigned int c, p, t, s, l, max;
+
+    max = cpus->count * (unsigned int)POLICY_COUNT * slices->count *
+        seeds->count * loads->count;
+    jobs = calloc(max, sizeof(job_t));
+    assert(jobs != NULL);
+    job_count = 0;
+
+    for (c = 0; c < cpus->count; c++)
+    for (p = 0; p < POLICY_COUNT; p++)
+    {
+        unsigned int slice_count = (p == POLICY_RR) ? slices->count : 1;
+
+        if (!policies[p])
+            continue;
+
+        for (t = 0; t < slice_count; t++)
+        for (s = 0; s < seeds->count; s++)
+        for (l = 0; l < loads->count; l++)
+        {
+            job_t *job = &jobs[job_count++];
+            job->cpus = cpus->values[c];
+            job->policy = (policy_t)p;
+            job->timeslice = (p == POLICY_RR) ? (int)slices->values[t] : -1;
+            job->seed = seeds->values[s];
+            job->load = loads->values[l];
+            job->horizon = job->load > 0 ? horizon : 0;
+            job->done = 0;
+        }
+    }
+}
+
+
+/*
+ * load_journal() marks every job that already has a row in the CSV journal
+ * as done.  Rows are matched on the (cpus, scheduler, time slice, seed,
+ * load, horizon) key, which is every parameter a run passes to the
+ * simulator; closed-workload runs have no horizon and record 0.  A journal
+ * from before the horizon column cannot be matched, so it is refused
+ * rather than silently rerun.
+ */
+static int load_journal(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[LINE_LENGTH];
+    unsigned int n, skipped = 0;
+
+    if (f == NULL)
+        return 0;
+
+    if (fgets(line, sizeof(line), f) != NULL &&
+        strncmp(line, JOURNAL_HEADER, strlen(JOURNAL_HEADER)) != 0)
+    {
+        fprintf(stderr, "sweep: %s is not a journal of this sweep version; "
+                "use a new output file\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        unsigned int cpus, seed, load, end;
+        int timeslice;
+        char policy[16];
+
+        if (sscanf(line, "%u,%15[^,],%d,%u,%u,%u,", &cpus, policy,
+                   &timeslice, &seed, &load, &end) != 6)
+            continue;
+
+        for (n = 0; n < job_count; n++)
+        {
+            if (!jobs[n].done && jobs[n].cpus == cpus &&
+                jobs[n].timeslice == timeslice && jobs[n].seed == seed &&
+                jobs[n].load == load && jobs[n].horizon == end &&
+                strcmp(policy_names[jobs[n].policy], policy) == 0)
+            {
+                jobs[n].done = 1;
+                skipped++;
+            }
+        }
+    }
+    fclose(f);
+
+    if (skipped > 0)
+        fprintf(stderr, "sweep: resuming, %u of %u runs already done\n",
+                skipped, job_count);
+    return 0;
+}
+
+
+/*
+ * run_job() forks the simulator with its stdout on a pipe and scrapes the
+ * final statistics from the end of the Gantt chart.
+ */
+static int run_job(const job_t *job, result_t *result)
+{
+    char cpus[16], slice[16], seed[16], arrivals[32], end[16];
+    char line[LINE_LENGTH], path[LINE_LENGTH];
+    char flag_r[] = "-r", flag_p[] = "-p", flag_s[] = "-S", flag_a[] = "-A";
+    char flag_t[] = "-T";
+    char *argv[12];
+    int fds[2], status, argc = 0, found = 0;
+    pid_t pid;
+    FILE *out;
+
+    result->throughput = 0.0;
+    snprintf(cpus, sizeof(cpus), "%u", job->cpus);
+    snprintf(slice, sizeof(slice), "%d", job->timeslice);
+    snprintf(seed, sizeof(seed), "%u", job->seed);
+    snprintf(path, sizeof(path), "%s", simulator_path);
+    snprintf(arrivals, sizeof(arrivals), "poisson:%g", job->load / 60.0);
+    snprintf(end, sizeof(end), "%u", job->horizon);
+
+    argv[argc++] = path;
+    argv[argc++] = cpus;
+    if (job->policy == POLICY_RR)
+    {
+        argv[argc++] = flag_r;
+        argv[argc++] = slice;
+    }
+    else if (job->policy == POLICY_PRIORITY)
+    {
+        argv[argc++] = flag_p;
+    }
+    argv[argc++] = flag_s;
+    argv[argc++] = seed;
+    if (job->load > 0)
+    {
+        argv[argc++] = flag_a;
+        argv[argc++] = arrivals;
+        argv[argc++] = flag_t;
+        argv[argc++] = end;
+    }
+    argv[argc] = NULL;
+
+    /*
+     * Other workers fork concurrently; a plain pipe() would leak this
+     * write end into their children, and our fgets() would not see EOF
+     * until those unrelated runs exited too.  dup2() clears the flag on
+     * the child's own stdout.
+     */
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+
+    pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(path, argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    out = fdopen(fds[0], "r");
+    assert(out != NULL);
+    while (fgets(line, sizeof(line), out) != NULL)
+    {
+        if (sscanf(line, "# of Context Switches: %u",
+                   &result->switches) == 1)
+            found |= 1;
+        else if (sscanf(line, "Total execution time: %lf",
+                        &result->exec_time) == 1)
+            found |= 2;
+        else if (sscanf(line, "Total time spent in READY state: %lf",
+                        &result->ready_time) == 1)
+            found |= 4;
+        else if (sscanf(line, "Throughput: %lf", &result->throughput) == 1)
+            found |= 8;
+        else if (sscanf(line, "Turnaround: mean %lf s, p50 %*f s, p95 %lf",
+                        &result->mean_turnaround,
+                        &result->p95_turnaround) == 2)
+            found |= 16;
+    }
+    fclose(out);
+
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+    /* Only a run in which some process finished reports 8 and 16 */
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || (found & 7) != 7)
+        return -1;
+    result->finished = (found & 16) != 0;
+    return 0;
+}
+
+static void *worker_thread_func(void *data)
+{
+    (void)data;
+
+    while (!cancelled)
+    {
+        job_t *job = NULL;
+        result_t result;
+        char turnaround[64];
+
+        pthread_mutex_lock(&queue_mutex);
+        while (next_job < job_count && jobs[next_job].done)
+            next_job++;
+        if (next_job < job_count)
+            job = &jobs[next_job++];
+        pthread_mutex_unlock(&queue_mutex);
+
+        if (job == NULL)
+            break;
+
+        if (run_job(job, &result) != 0)
+        {
+            /* A run killed by Ctrl-C is not a result; leave it for resume */
+            if (!cancelled)
+                fprintf(stderr, "sweep: run failed: %u cpus, %s, slice %d, "
+                        "seed %u, load %u, horizon %u\n", job->cpus,
+                        policy_names[job->policy], job->timeslice, job->seed,
+                        job->load, job->horizon);
+            continue;
+        }
+
+        if (result.finished)
+            snprintf(turnaround, sizeof(turnaround), "%.1f,%.1f",
+                     result.mean_turnaround, result.p95_turnaround);
+        else
+            strcpy(turnaround, ",");
+
+        pthread_mutex_lock(&output_mutex);
+        fprintf(journal, "%u,%s,%d,%u,%u,%u,%u,%.1f,%.1f,%.3f,%s\n",
+                job->cpus, policy_names[job->policy], job->timeslice,
+                job->seed, job->load, job->horizon, result.switches,
+                result.exec_time, result.ready_time, result.throughput,
+                turnaround);
+        fflush(journal);
+        job->done = 1;
+        pthread_mutex_unlock(&output_mutex);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * write_json() re-reads the journal rather than the in-memory jobs, so the
+ * table also covers rows produced by earlier, resumed invocations.
+ */
+static void write_json(const char *journal_path, const char *json_path)
+{
+    FILE *in = fopen(journal_path, "r");
+    FILE *out = fopen(json_path, "w");
+    char line[LINE_LENGTH];
+    int first = 1;
+
+    if (in == NULL || out == NULL)
+    {
+        fprintf(stderr, "sweep: cannot write %s\n", json_path);
+        if (in != NULL)
+            fclose(in);
+        if (out != NULL)
+            fclose(out);
+        return;
+    }
+
+    fprintf(out, "[");
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        unsigned int cpus, seed, load, end;
+        int timeslice, used = 0;
+        result_t r;
+        char policy[16], turnaround[64];
+
+        if (sscanf(line, "%u,%15[^,],%d,%u,%u,%u,%u,%lf,%lf,%lf%n",
+                   &cpus, policy, &timeslice, &seed, &load, &end,
+                   &r.switches, &r.exec_time, &r.ready_time, &r.throughput,
+                   &used) != 10 || used == 0)
+            continue;
+        r.finished = sscanf(line + used, ",%lf,%lf", &r.mean_turnaround,
+                            &r.p95_turnaround) == 2;
+        if (r.finished)
+            snprintf(turnaround, sizeof(turnaround), "%.1f, "
+                     "\"p95_turnaround\": %.1f", r.mean_turnaround,
+                     r.p95_turnaround);
+        else
+            strcpy(turnaround, "null, \"p95_turnaround\": null");
+
+        fprintf(out, "%s\n  {\"cpus\": %u, \"scheduler\": \"%s\", "
+                "\"timeslice\": %d, \"seed\": %u, \"load\": %u, "
+                "\"horizon\": %u, "
+                "\"context_switches\": %u, \"execution_time\": %.1f, "
+                "\"ready_time\": %.1f, \"throughput\": %.3f, "
+                "\"mean_turnaround\": %s}",
+                first ? "" : ",", cpus, policy, timeslice, seed, load, end,
+                r.switches, r.exec_time, r.ready_time, r.throughput,
+                turnaround);
+        first = 0;
+    }
+    fprintf(out, "\n]\n");
+
+    fclose(in);
+    fclose(out);
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    cancelled = 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+    range_t cpus, slices, seeds, loads;
+    int policies[POLICY_COUNT];
+    const char *output = NULL, *json = NULL;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *threads;
+    struct sigaction sa;
+    unsigned int n, remaining = 0;
+    int opt;
+
+    parse_range("1-4", &cpus);
+    parse_range("2-8:2", &slices);
+    parse_range("0", &seeds);
+    parse_range("0", &loads);
+    parse_policies("fifo,rr,prio", policies);
+
+    while ((opt = getopt(argc, argv, "c:p:t:s:l:T:j:b:o:J:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            if (parse_range(optarg, &cpus) != 0) { help(); return -1; }
+            break;
+        case 'p':
+            if (parse_policies(optarg, policies) != 0) { help(); return -1; }
+            break;
+        case 't':
+            if (parse_range(optarg, &slices) != 0) { help(); return -1; }
+            break;
+        case 's':
+            if (parse_range(optarg, &seeds) != 0) { help(); return -1; }
+            break;
+        case 'l':
+            if (parse_range(optarg, &loads) != 0) { help(); return -1; }
+            break;
+        case 'T':
+            horizon = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            workers = strtol(optarg, NULL, 0);
+            break;
+        case 'b':
+            simulator_path = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'J':
+            json = optarg;
+            break;
+        default:
+            help();
+            return -1;
+        }
+    }
+
+    if (output == NULL || workers < 1)
+    {
+        help();
+        return -1;
+    }
+
+    build_jobs(&cpus, policies, &slices, &seeds, &loads);
+    if (load_journal(output) != 0)
+        return -1;
+
+    journal = fopen(output, "a");
+    if (journal == NULL)
+    {
+        perror(output);
+        return -1;
+    }
+    fseek(journal, 0, SEEK_END);
+    if (ftell(journal) == 0)
+        fprintf(journal, JOURNAL_HEADER "context_switches,execution_time,"
+                "ready_time,throughput,mean_turnaround,p95_turnaround\n");
+
+    /* Ctrl-C stops handing out jobs; finished rows are already on disk */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    threads = malloc(sizeof(pthread_t) * (size_t)workers);
+    assert(threads != NULL);
+    for (n = 0; n < (unsigned int)workers; n++)
+        pthread_create(&threads[n], NULL, worker_thread_func, NULL);
+    for (n = 0; n < (unsigned int)workers; n++)
+        pthread_join(threads[n], NULL);
+    fclose(journal);
+
+    for (n = 0; n < job_count; n++)
+        remaining += !jobs[n].done;
+
+    if (json != NULL)
+        write_json(output, json);
+
+    if (remaining > 0)
+    {
+        fprintf(stderr, "sweep: %u of %u runs not done; rerun to resume\n",
+                remaining, job_count);
+        return 1;
+    }
+
+    return 0;
+}